@@ -0,0 +1,72 @@
+"use strict";
+
+// Compares queries over gzipped tiles with the same queries over uncompressed tiles, to measure
+// the time spent decompressing. Run it against a build with and one without libdeflate:
+//
+//   make clean && make && node bench/decompress.bench.js --iterations 500 --concurrency 1
+//   make clean && make LIBDEFLATE=true && node bench/decompress.bench.js --iterations 500 --concurrency 1
+
+const argv = require('minimist')(process.argv.slice(2));
+if (!argv.iterations || !argv.concurrency) {
+  console.error('Please provide desired iterations, concurrency');
+  console.error('Example: \nnode bench/decompress.bench.js --iterations 500 --concurrency 1');
+  process.exit(1);
+}
+
+// see bench/vtquery.bench.js
+process.env.UV_THREADPOOL_SIZE = argv.concurrency;
+
+const zlib = require('zlib');
+const Queue = require('d3-queue').queue;
+const vtquery = require('../lib/index.js');
+const rules = require('./rules');
+
+// the tile cache would skip decompressing after the first run
+vtquery.setCacheSize(0);
+
+const ruleQueue = Queue(1);
+rules.forEach(function(rule, i) {
+  ruleQueue.defer(compareRule, i + 1, rule);
+});
+
+ruleQueue.awaitAll(function(err) {
+  if (err) throw err;
+  process.stdout.write('\n');
+});
+
+function compareRule(ruleCount, rule, callback) {
+  const gzipped = rule.tiles.map(function(tile) {
+    return { z: tile.z, x: tile.x, y: tile.y, buffer: zlib.gzipSync(uncompressed(tile.buffer)) };
+  });
+  const raw = rule.tiles.map(function(tile) {
+    return { z: tile.z, x: tile.x, y: tile.y, buffer: uncompressed(tile.buffer) };
+  });
+
+  process.stdout.write(`\n${ruleCount}: ${rule.description} ... `);
+  timeRuns(raw, rule, function(err, rawTime) {
+    if (err) return callback(err);
+    timeRuns(gzipped, rule, function(err, gzippedTime) {
+      if (err) return callback(err);
+      const perRun = (gzippedTime - rawTime) / argv.iterations;
+      process.stdout.write(`uncompressed ${rawTime}ms, gzipped ${gzippedTime}ms, ${perRun.toFixed(3)}ms decompressing per query`);
+      return callback();
+    });
+  });
+}
+
+// total milliseconds for `iterations` queries over `tiles`
+function timeRuns(tiles, rule, callback) {
+  const runsQueue = Queue();
+  const time = +(new Date());
+  for (let i = 0; i < argv.iterations; i++) {
+    runsQueue.defer(vtquery, tiles, rule.queryPoint, rule.options);
+  }
+  runsQueue.awaitAll(function(err) {
+    if (err) return callback(err);
+    return callback(null, +(new Date()) - time);
+  });
+}
+
+function uncompressed(buffer) {
+  return buffer[0] === 0x1f && buffer[1] === 0x8b ? zlib.gunzipSync(buffer) : buffer;
+}
@@ -11,6 +11,12 @@
   'includes': [ 'common.gypi' ], # brings in a default set of options that are inherited from gyp
   'variables': { # custom variables we use specific to this file
       'error_on_warnings%':'true', # can be overriden by a command line variable because of the % sign using "WERROR" (defined in Makefile)
+      # inflate gzipped tiles with libdeflate (found in the system's include and library paths) instead of zlib,
+      # set with "LIBDEFLATE" (defined in Makefile)
+      'use_libdeflate%':'false',
+      # decompress zstd compressed tiles with libzstd (found in the system's include and library paths),
+      # set with "ZSTD" (defined in Makefile)
+      'use_zstd%':'false',
       # Use this variable to silence warnings from mason dependencies and from NAN
       # It's a variable to make easy to pass to
       # cflags (linux) and xcode (mac)
@@ -73,7 +79,14 @@
       # See: https://github.com/mapbox/node-cpp-skel/pull/44#discussion_r122050205
       'sources': [
         './src/module.cpp',
-        './src/vtquery.cpp'
+        './src/vtquery.cpp',
+        './src/segment_kernels.cpp',
+        './src/thread_pool.cpp',
+        './src/vector_tile_handle.cpp',
+        './src/feature_rtree.cpp',
+        './src/polygon_slabs.cpp',
+        './src/tile_cache.cpp',
+        './src/tile_decompressor.cpp'
       ],
       'ldflags': [
         '-Wl,-z,now',
@@ -84,6 +97,14 @@
             'xcode_settings': {
               'OTHER_CPLUSPLUSFLAGS': [ '-Werror' ]
             }
+        }],
+        ['use_libdeflate == "true"', {
+            'defines': [ 'VTQUERY_USE_LIBDEFLATE' ],
+            'libraries': [ '-ldeflate' ]
+        }],
+        ['use_zstd == "true"', {
+            'defines': [ 'VTQUERY_USE_ZSTD' ],
+            'libraries': [ '-lzstd' ]
         }]
       ],
       'cflags': [
@@ -3,17 +3,32 @@
 /**
  * @name vtquery
  *
- * @param {Array<Object>} tiles an array of tile objects with `buffer`, `z`, `x`, and `y` values
+ * @param {Array<Object|VectorTileHandle>} tiles an array of tile objects with `buffer`, `z`, `x`, and `y` values, or
+ * `VectorTileHandle`s of tiles that are queried often
  * @param {Array<Number>} LngLat a query point of longitude and latitude to query, `[lng, lat]`
  * @param {Object} [options]
  * @param {Number} [options.radius=0] the radius to query for features. If your radius is larger than
  * the extent of an individual tile, include multiple nearby buffers to collect a realistic list of features
  * @param {Number} [options.limit=5] limit the number of results/features returned from the query. Minimum is 1, maximum is 1000 (to avoid pre allocating large amounts of memory)
  * @param {Array<String>} [options.layers] an array of layer string names to query from. Default is all layers.
+ * @param {Array<String>|Boolean} [options.properties=true] only return the properties with these keys, or none with `false`
+ * (`properties.tilequery` is always there). The other properties are never decoded. Deduplication still compares every property.
  * @param {String} [options.geometry] only return features of a particular geometry type. Can be `point`, `linestring`, or `polygon`.
  * Defaults to all geometry types.
  * @param {String} [options.dedup=true] perform deduplication of features based on shared layers, geometry, IDs and matching
  * properties.
+ * @param {String} [options.dedupe_key='both'] which feature attributes are compared when deduplicating. `id` only compares
+ * feature ids (features without an id are never duplicates) and skips hashing properties, `properties` ignores ids, and `both`
+ * compares properties and ids (when both features have one).
+ * @param {Boolean} [options.tile_distance=false] rank features by their distance measured in tile coordinates, and only convert
+ * the final results to longitude/latitude and meters. This is faster for large radii and limits, but features at (almost) the
+ * same distance may be ranked differently. See "Distances" below for the error bounds.
+ * @param {Boolean} [options.stats=false] add a `tilequery` object to the response with the number of `tiles` queried
+ * and the number of `tiles_skipped` because they are entirely out of the radius.
+ * @param {Boolean} [options.parallel=false] decompress and scan the tiles on several threads of a process-wide pool instead of
+ * one after the other. The results are the same, but every tile is read, since tiles can no longer be skipped as results come in.
+ * @param {Boolean} [options.streaming=false] scan the layers of gzip or zlib compressed tiles while they are inflated, and stop inflating once the
+ * rest of a tile is out of reach. Only one layer of a tile is kept in memory at a time. See "Compressed tiles" below.
  * @param {Array<String,Array>} [options.basic-filters] - an expression-like filter to include features with Numeric or Boolean properties
  * that match the filters based on the following conditions: `=, !=, <, <=, >, >=`. The first item must be the value "any" or "all" whether
  * any or all filters must evaluate to true.
@@ -40,4 +55,123 @@
  *   console.log(result); // geojson FeatureCollection
  * });
  */
-module.exports = require('./binding/vtquery.node').vtquery;
+const binding = require('./binding/vtquery.node');
+
+/**
+ * A tile that is decompressed and parsed once, to be passed to `vtquery` in place of a tile object
+ * as many times as needed. Its `z`, `x` and `y` values can be read.
+ *
+ * @name VectorTileHandle.create
+ *
+ * @param {Object} tile a tile object with `buffer`, `z`, `x`, and `y` values, the buffer may be compressed
+ * @param {Object} [options]
+ * @param {Boolean} [options.index=false] build a spatial index of the features of every layer, the first time the layer is
+ * queried, so queries only visit the features near the query point. This helps when the radius is small compared to the tile.
+ * @param {Function} callback called with an error if the buffer is not a valid vector tile, or the `VectorTileHandle`
+ *
+ * @example
+ * const vtquery = require('@mapbox/vtquery');
+ *
+ * vtquery.VectorTileHandle.create({ buffer: fs.readFileSync('./path/to/tile.mvt'), z: 15, x: 5238, y: 12666 }, function(err, handle) {
+ *   if (err) throw err;
+ *   vtquery([handle], [-122.4477, 37.7665], { radius: 10 }, function(err, result) {});
+ * });
+ */
+
+/**
+ * Query many points against the same tiles in one call. The tiles are decompressed and parsed once and the points
+ * are queried on a process-wide pool of threads, the results are the same as calling `vtquery` for each point.
+ *
+ * @name batch
+ *
+ * @param {Array<Object|VectorTileHandle>} tiles an array of tile objects with `buffer`, `z`, `x`, and `y` values, or
+ * `VectorTileHandle`s, like `vtquery`
+ * @param {Array<Array<Number>>} points the query points, each an array of longitude and latitude `[lng, lat]`
+ * @param {Object} [options] the options of `vtquery`, except `parallel` and `streaming` which don't apply
+ * @param {Function} callback called with an error, or an array of FeatureCollections with the results of every point,
+ * in the order of `points`
+ *
+ * @example
+ * const vtquery = require('@mapbox/vtquery');
+ *
+ * vtquery.batch(tiles, [[-122.4477, 37.7665], [-122.4482, 37.7670]], { radius: 10 }, function(err, results) {
+ *   if (err) throw err;
+ *   console.log(results[1]); // geojson FeatureCollection of the second point
+ * });
+ */
+
+/**
+ * Spatial join of many points against the polygons of a tile: find the polygon features that contain each point.
+ * The polygons are decoded once and test the points near them on a process-wide pool of threads.
+ *
+ * @name join
+ *
+ * @param {Object|VectorTileHandle} tile a tile object with `buffer`, `z`, `x`, and `y` values, or a `VectorTileHandle`
+ * @param {Float64Array} points the points, longitude and latitude one after the other `[lng0, lat0, lng1, lat1, ...]`
+ * @param {Object} [options]
+ * @param {Array<String>} [options.layers] an array of layer string names to join with. Default is all layers.
+ * @param {Array<String>|Boolean} [options.properties=true] only return the properties with these keys, or none with `false`
+ * @param {Function} callback called with an error, or an object with the `features` that contain any point (GeoJSON features
+ * without a geometry), and two `Uint32Array`s: the features of point `i` are `features[indexes[j]]` for `j` from `offsets[i]`
+ * to `offsets[i + 1] - 1`, in the order of the tile
+ *
+ * @example
+ * const vtquery = require('@mapbox/vtquery');
+ *
+ * vtquery.join(tile, new Float64Array([-122.4477, 37.7665, -122.4482, 37.7670]), { layers: ['landuse'] }, function(err, result) {
+ *   if (err) throw err;
+ *   for (let j = result.offsets[1]; j < result.offsets[2]; ++j) {
+ *     console.log(result.features[result.indexes[j]]); // a landuse polygon the second point is in
+ *   }
+ * });
+ */
+
+/**
+ * Set the size of the process-wide cache of decompressed tiles. Queries look up compressed tile buffers in the cache
+ * before decompressing them, by their bytes, so the same tile data is only decompressed once while it stays cached.
+ * The least recently used tiles are evicted to stay within the size.
+ *
+ * @name setCacheSize
+ *
+ * @param {Number} bytes the memory the compressed and decompressed bytes of the cached tiles may use. The default is 0,
+ * which disables the cache, setting it to 0 empties it.
+ *
+ * @example
+ * vtquery.setCacheSize(64 * 1024 * 1024);
+ */
+
+/**
+ * Statistics of the tile cache since the process started.
+ *
+ * @name cacheStats
+ *
+ * @returns {Object} `size` of the cache in bytes, the `bytes` and number of `entries` currently cached, and the number
+ * of `hits`, `misses` and `evictions`
+ */
+
+/**
+ * Add a zstd dictionary, to decompress the zstd compressed tiles whose frames name its dictionary id.
+ * Needs vtquery to be built with zstd (`make ZSTD=true`).
+ *
+ * @name addZstdDictionary
+ *
+ * @param {Buffer} dictionary a zstd dictionary with a dictionary id, like the ones made by `zstd --train`. Adding the same
+ * dictionary again does nothing, adding a different one with the same id throws.
+ */
+
+/**
+ * The instruction set the segment distance and ring crossing kernels were picked for when the module was loaded.
+ * The best one the CPU supports is used unless the `VTQUERY_INSTRUCTION_SET` environment variable names a worse one.
+ *
+ * @name instructionSet
+ *
+ * @returns {String} `avx2`, `sse4.2` or `scalar`
+ */
+module.exports = binding.vtquery;
+module.exports.batch = binding.batch;
+module.exports.join = binding.join;
+module.exports.VectorTileHandle = binding.VectorTileHandle;
+module.exports.setCacheSize = binding.setCacheSize;
+module.exports.cacheStats = binding.cacheStats;
+module.exports.addZstdDictionary = binding.addZstdDictionary;
+module.exports.instructionSet = binding.instructionSet;
@@ -0,0 +1,539 @@
+#pragma once
+#include "segment_kernels.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <mapbox/geometry/algorithms/closest_point.hpp>
+#include <mapbox/geometry/geometry.hpp>
+#include <vector>
+#include <vtzero/geometry.hpp>
+#include <vtzero/vector_tile.hpp>
+
+namespace VectorTileQuery {
+
+/*
+  Streaming closest point calculation on an encoded vtzero geometry.
+
+  This is a vtzero geometry handler, so the MoveTo/LineTo/ClosePath commands are
+  consumed as they are decoded and only the running best candidate is kept. It
+  follows the semantics of mapbox::geometry::algorithms::closest_point:
+
+  - points: the closest point of a (multi)point
+  - linestrings: the closest point along any segment
+  - polygons: the query point itself (distance 0.0) if it is within a polygon,
+    otherwise the closest point along any of its rings
+
+  Rings are grouped into polygons the same way mapbox::vector_tile::extract_geometry
+  does it: an outer ring starts a new polygon and every following ring belongs to it.
+  Nothing is allocated on the heap.
+
+  Linestrings and rings are processed in blocks of points. If a `max_distance` is
+  given, blocks whose bounding box is further than that from the query point skip
+  the closest point calculation (rings still count their crossings). The result is
+  then only exact if it is within `max_distance`, anything else is further than that.
+  The segments of a block are measured with the kernels in segment_kernels.hpp.
+*/
+class closest_point_handler {
+  public:
+    explicit closest_point_handler(mapbox::geometry::point<std::int64_t> const& query_point,
+                                   double max_distance = std::numeric_limits<double>::infinity())
+        : qx_(static_cast<double>(query_point.x)),
+          qy_(static_cast<double>(query_point.y)),
+          bounded_(max_distance < std::numeric_limits<double>::infinity()),
+          max_squared_distance_(bounded_ ? max_distance * max_distance : 0.0) {}
+
+    void points_begin(std::uint32_t /*count*/) {}
+
+    void points_point(vtzero::point const& pt) {
+        double const x = pt.x;
+        double const y = pt.y;
+        keep_closer({x, y, (x - qx_) * (x - qx_) + (y - qy_) * (y - qy_)}, best_);
+    }
+
+    void points_end() {}
+
+    void linestring_begin(std::uint32_t /*count*/) {
+        block_size_ = 0;
+    }
+
+    void linestring_point(vtzero::point const& pt) {
+        add_to_block(pt, best_, false);
+    }
+
+    void linestring_end() {
+        flush_block(best_, false);
+    }
+
+    void ring_begin(std::uint32_t /*count*/) {
+        block_size_ = 0;
+        ring_ = candidate{};
+        ring_crossings_ = false;
+    }
+
+    void ring_point(vtzero::point const& pt) {
+        add_to_block(pt, ring_, true);
+    }
+
+    void ring_end(vtzero::ring_type type) {
+        flush_block(ring_, true);
+        if (type == vtzero::ring_type::outer) {
+            if (in_polygon_) {
+                keep_closer(polygon_result(), best_);
+            }
+            polygon_ = candidate{};
+            polygon_inside_ = false;
+            in_polygon_ = true;
+        }
+        // rings that show up before the first outer ring are not part of any polygon
+        if (!in_polygon_) {
+            return;
+        }
+        keep_closer(ring_, polygon_);
+        polygon_inside_ = polygon_inside_ != ring_crossings_;
+    }
+
+    /// closest point of everything decoded so far, distance is -1.0 if there was no geometry
+    mapbox::geometry::algorithms::closest_point_info result() const {
+        candidate best = best_;
+        if (in_polygon_) {
+            keep_closer(polygon_result(), best);
+        }
+        if (!best.valid()) {
+            return mapbox::geometry::algorithms::closest_point_info{};
+        }
+        return mapbox::geometry::algorithms::closest_point_info{best.x, best.y, std::sqrt(best.squared_distance)};
+    }
+
+  private:
+    struct candidate {
+        double x = 0.0;
+        double y = 0.0;
+        double squared_distance = std::numeric_limits<double>::max();
+
+        bool valid() const {
+            return squared_distance < std::numeric_limits<double>::max();
+        }
+    };
+
+    // a block holds the last point of the previous block and up to `block_points` new points
+    static constexpr std::size_t block_points = 32;
+
+    // shorter runs of segments are cheaper inline than through the vectorized kernels
+    enum : std::size_t { kernel_min_segments = 8 };
+
+    // unlike vtzero::point this is not zero-initialized, to keep constructing a handler cheap
+    using block_point = kernels::segment_point;
+
+    void add_to_block(vtzero::point const& pt, candidate& best, bool ring) {
+        block_[block_size_++] = block_point{pt.x, pt.y};
+        if (block_size_ == block_.size()) {
+            flush_block(best, ring);
+        }
+    }
+
+    /// process the segments of the current block, keep its last point to start the next one
+    void flush_block(candidate& best, bool ring) {
+        if (block_size_ < 2) {
+            return;
+        }
+        bool near = true;
+        if (bounded_ || ring) {
+            std::int32_t min_x = block_[0].x;
+            std::int32_t max_x = block_[0].x;
+            std::int32_t min_y = block_[0].y;
+            std::int32_t max_y = block_[0].y;
+            for (std::size_t i = 1; i < block_size_; ++i) {
+                min_x = std::min(min_x, block_[i].x);
+                max_x = std::max(max_x, block_[i].x);
+                min_y = std::min(min_y, block_[i].y);
+                max_y = std::max(max_y, block_[i].y);
+            }
+            if (bounded_) {
+                double const dx = std::max({min_x - qx_, 0.0, qx_ - max_x});
+                double const dy = std::max({min_y - qy_, 0.0, qy_ - max_y});
+                near = dx * dx + dy * dy <= max_squared_distance_;
+            }
+            // a ray from the query point can only cross the block if it spans the query point's y
+            if (ring && (min_y > qy_) != (max_y > qy_)) {
+                bool odd = false;
+                if (block_size_ > kernel_min_segments) {
+                    odd = kernels::odd_crossings(block_.data(), block_size_, qx_, qy_);
+                } else {
+                    for (std::size_t i = 1; i < block_size_; ++i) {
+                        odd = odd != detail::crosses(qx_, qy_, block_[i - 1], block_[i]);
+                    }
+                }
+                ring_crossings_ = ring_crossings_ != odd;
+            }
+        }
+        if (near) {
+            if (block_size_ > kernel_min_segments) {
+                double squared_distance;
+                std::size_t const i = kernels::closest_segment(block_.data(), block_size_, qx_, qy_, squared_distance);
+                if (squared_distance < best.squared_distance) {
+                    best = closest_on_segment(block_[i], block_[i + 1]);
+                }
+            } else {
+                for (std::size_t i = 1; i < block_size_; ++i) {
+                    keep_closer(closest_on_segment(block_[i - 1], block_[i]), best);
+                }
+            }
+        }
+        block_[0] = block_[block_size_ - 1];
+        block_size_ = 1;
+    }
+
+    static void keep_closer(candidate const& c, candidate& best) {
+        if (c.squared_distance < best.squared_distance) {
+            best = c;
+        }
+    }
+
+    candidate closest_on_segment(block_point const& a, block_point const& b) const {
+        candidate c;
+        c.squared_distance = detail::closest_on_segment(qx_, qy_, a, b, c.x, c.y);
+        return c;
+    }
+
+    /// a polygon that contains the query point is a direct hit
+    candidate polygon_result() const {
+        if (polygon_inside_) {
+            return {qx_, qy_, 0.0};
+        }
+        return polygon_;
+    }
+
+    double qx_;
+    double qy_;
+    bool bounded_;
+    double max_squared_distance_;
+    candidate best_{};
+    candidate polygon_{};
+    candidate ring_{};
+    std::array<block_point, block_points + 1> block_;
+    std::size_t block_size_ = 0;
+    bool ring_crossings_ = false;
+    bool polygon_inside_ = false;
+    bool in_polygon_ = false;
+};
+
+/*
+  The geometry of a feature decoded once, to be measured against many query points.
+
+  decode() is a vtzero geometry handler that records the points of every part and
+  its bounding box, and replay() hands them to another handler in the same order
+  vtzero::decode_geometry() would, so a handler gets the same result from either.
+  The buffers are kept from one feature to the next.
+*/
+class decoded_geometry {
+  public:
+    /// decode the geometry of `feature`, vtzero throws if it is not valid
+    void decode(vtzero::feature const& feature) {
+        parts_.clear();
+        points_.clear();
+        min_x_ = std::numeric_limits<std::int32_t>::max();
+        min_y_ = std::numeric_limits<std::int32_t>::max();
+        max_x_ = std::numeric_limits<std::int32_t>::min();
+        max_y_ = std::numeric_limits<std::int32_t>::min();
+        vtzero::decode_geometry(feature.geometry(), *this);
+    }
+
+    template <typename Handler>
+    void replay(Handler& handler) const {
+        for (auto const& part : parts_) {
+            auto const count = static_cast<std::uint32_t>(part.end - part.begin);
+            switch (part.type) {
+            case part_type::points:
+                handler.points_begin(count);
+                for (std::size_t i = part.begin; i < part.end; ++i) {
+                    handler.points_point(points_[i]);
+                }
+                handler.points_end();
+                break;
+            case part_type::linestring:
+                handler.linestring_begin(count);
+                for (std::size_t i = part.begin; i < part.end; ++i) {
+                    handler.linestring_point(points_[i]);
+                }
+                handler.linestring_end();
+                break;
+            case part_type::ring:
+                handler.ring_begin(count);
+                for (std::size_t i = part.begin; i < part.end; ++i) {
+                    handler.ring_point(points_[i]);
+                }
+                handler.ring_end(part.ring);
+                break;
+            }
+        }
+    }
+
+    /// squared distance from the query point to the bounding box, infinity if there are no points
+    double squared_distance(mapbox::geometry::point<std::int64_t> const& query_point) const {
+        if (points_.empty()) {
+            return std::numeric_limits<double>::infinity();
+        }
+        double const qx = static_cast<double>(query_point.x);
+        double const qy = static_cast<double>(query_point.y);
+        double const dx = std::max({min_x_ - qx, 0.0, qx - max_x_});
+        double const dy = std::max({min_y_ - qy, 0.0, qy - max_y_});
+        return dx * dx + dy * dy;
+    }
+
+    std::int32_t min_x() const {
+        return min_x_;
+    }
+
+    std::int32_t min_y() const {
+        return min_y_;
+    }
+
+    std::int32_t max_x() const {
+        return max_x_;
+    }
+
+    std::int32_t max_y() const {
+        return max_y_;
+    }
+
+    bool empty() const {
+        return points_.empty();
+    }
+
+    // vtzero geometry handler
+
+    void points_begin(std::uint32_t /*count*/) {
+        begin_part(part_type::points);
+    }
+
+    void points_point(vtzero::point const& pt) {
+        add_point(pt);
+    }
+
+    void points_end() {
+        end_part(vtzero::ring_type::invalid);
+    }
+
+    void linestring_begin(std::uint32_t /*count*/) {
+        begin_part(part_type::linestring);
+    }
+
+    void linestring_point(vtzero::point const& pt) {
+        add_point(pt);
+    }
+
+    void linestring_end() {
+        end_part(vtzero::ring_type::invalid);
+    }
+
+    void ring_begin(std::uint32_t /*count*/) {
+        begin_part(part_type::ring);
+    }
+
+    void ring_point(vtzero::point const& pt) {
+        add_point(pt);
+    }
+
+    void ring_end(vtzero::ring_type type) {
+        end_part(type);
+    }
+
+  private:
+    enum class part_type : std::uint8_t {
+        points,
+        linestring,
+        ring
+    };
+
+    struct part {
+        part_type type;
+        vtzero::ring_type ring;
+        std::size_t begin;
+        std::size_t end;
+    };
+
+    void begin_part(part_type type) {
+        parts_.push_back(part{type, vtzero::ring_type::invalid, points_.size(), points_.size()});
+    }
+
+    void add_point(vtzero::point const& pt) {
+        points_.push_back(pt);
+        min_x_ = std::min(min_x_, pt.x);
+        min_y_ = std::min(min_y_, pt.y);
+        max_x_ = std::max(max_x_, pt.x);
+        max_y_ = std::max(max_y_, pt.y);
+    }
+
+    void end_part(vtzero::ring_type type) {
+        parts_.back().ring = type;
+        parts_.back().end = points_.size();
+    }
+
+    std::vector<part> parts_;
+    std::vector<vtzero::point> points_;
+    std::int32_t min_x_ = 0;
+    std::int32_t min_y_ = 0;
+    std::int32_t max_x_ = 0;
+    std::int32_t max_y_ = 0;
+};
+
+/// hand the geometry of a feature to a vtzero geometry handler, decoding it or replaying a decoded_geometry
+template <typename Handler>
+void decode_geometry(vtzero::feature const& feature, Handler& handler) {
+    vtzero::decode_geometry(feature.geometry(), handler);
+}
+
+template <typename Handler>
+void decode_geometry(decoded_geometry const& geometry, Handler& handler) {
+    geometry.replay(handler);
+}
+
+/// closest point of a feature's geometry (a vtzero::feature or decoded_geometry) to the query point, without
+/// materializing the geometry (only exact within `max_distance` tile units, see closest_point_handler)
+template <typename Geometry>
+mapbox::geometry::algorithms::closest_point_info feature_closest_point(Geometry const& geometry,
+                                                                       mapbox::geometry::point<std::int64_t> const& query_point,
+                                                                       double max_distance = std::numeric_limits<double>::infinity()) {
+    closest_point_handler handler{query_point, max_distance};
+    decode_geometry(geometry, handler);
+    return handler.result();
+}
+
+/*
+  Direct hit test on an encoded vtzero geometry: is the query point within a polygon,
+  or is any point or segment within `near_distance` of it.
+
+  Polygons only run the crossing number test, grouped into polygons like
+  closest_point_handler does it, and a segment is only measured if the query point is
+  within its bounding box grown by `near_distance`. Nothing else is calculated, so
+  geometries that neither contain nor come close to the query point are rejected at
+  the cost of a single pass over their encoded points.
+*/
+class direct_hit_handler {
+  public:
+    direct_hit_handler(mapbox::geometry::point<std::int64_t> const& query_point, double near_distance)
+        : qx_(static_cast<double>(query_point.x)),
+          qy_(static_cast<double>(query_point.y)),
+          near_distance_(near_distance),
+          near_squared_distance_(near_distance * near_distance) {}
+
+    void points_begin(std::uint32_t /*count*/) {}
+
+    void points_point(vtzero::point const& pt) {
+        double const x = pt.x;
+        double const y = pt.y;
+        if ((x - qx_) * (x - qx_) + (y - qy_) * (y - qy_) <= near_squared_distance_) {
+            near_ = true;
+        }
+    }
+
+    void points_end() {}
+
+    void linestring_begin(std::uint32_t /*count*/) {
+        has_previous_ = false;
+    }
+
+    void linestring_point(vtzero::point const& pt) {
+        if (!near_ && has_previous_ && is_near(previous_, pt)) {
+            near_ = true;
+        }
+        previous_ = pt;
+        has_previous_ = true;
+    }
+
+    void linestring_end() {}
+
+    void ring_begin(std::uint32_t /*count*/) {
+        has_previous_ = false;
+        ring_crossings_ = false;
+    }
+
+    void ring_point(vtzero::point const& pt) {
+        if (has_previous_) {
+            if (detail::crosses(qx_, qy_, previous_, pt)) {
+                ring_crossings_ = !ring_crossings_;
+            }
+            if (!near_ && is_near(previous_, pt)) {
+                near_ = true;
+            }
+        }
+        previous_ = pt;
+        has_previous_ = true;
+    }
+
+    void ring_end(vtzero::ring_type type) {
+        if (type == vtzero::ring_type::outer) {
+            contains_ = contains_ || polygon_inside_;
+            polygon_inside_ = false;
+            in_polygon_ = true;
+        }
+        // rings that show up before the first outer ring are not part of any polygon
+        if (!in_polygon_) {
+            return;
+        }
+        polygon_inside_ = polygon_inside_ != ring_crossings_;
+    }
+
+    /// is the query point within any of the polygons
+    bool contains() const {
+        return contains_ || polygon_inside_;
+    }
+
+    /// is any point or segment within `near_distance` of the query point
+    bool near() const {
+        return near_;
+    }
+
+  private:
+    bool is_near(vtzero::point const& a, vtzero::point const& b) const {
+        if (qx_ + near_distance_ < std::min(a.x, b.x) || qx_ - near_distance_ > std::max(a.x, b.x) ||
+            qy_ + near_distance_ < std::min(a.y, b.y) || qy_ - near_distance_ > std::max(a.y, b.y)) {
+            return false;
+        }
+        double x;
+        double y;
+        return detail::closest_on_segment(qx_, qy_, a, b, x, y) <= near_squared_distance_;
+    }
+
+    double qx_;
+    double qy_;
+    double near_distance_;
+    double near_squared_distance_;
+    vtzero::point previous_{};
+    bool has_previous_ = false;
+    bool ring_crossings_ = false;
+    bool polygon_inside_ = false;
+    bool in_polygon_ = false;
+    bool contains_ = false;
+    bool near_ = false;
+};
+
+/// closest point of a feature's geometry (a vtzero::feature or decoded_geometry) to the query point if it is within
+/// `near_distance` tile units, otherwise distance is -1.0 (see direct_hit_handler, only the near ones are measured)
+template <typename Geometry>
+mapbox::geometry::algorithms::closest_point_info feature_direct_hit(Geometry const& geometry,
+                                                                    mapbox::geometry::point<std::int64_t> const& query_point,
+                                                                    double near_distance) {
+    direct_hit_handler handler{query_point, near_distance};
+    decode_geometry(geometry, handler);
+    if (handler.contains()) {
+        return mapbox::geometry::algorithms::closest_point_info{static_cast<double>(query_point.x), static_cast<double>(query_point.y), 0.0};
+    }
+    if (handler.near()) {
+        return feature_closest_point(geometry, query_point, near_distance);
+    }
+    return mapbox::geometry::algorithms::closest_point_info{};
+}
+
+/// is the query point within any of the polygons of a feature's geometry (a vtzero::feature or decoded_geometry)
+template <typename Geometry>
+bool feature_contains(Geometry const& geometry, mapbox::geometry::point<std::int64_t> const& query_point) {
+    direct_hit_handler handler{query_point, 0.0};
+    decode_geometry(geometry, handler);
+    return handler.contains();
+}
+
+} // namespace VectorTileQuery
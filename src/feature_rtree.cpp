@@ -0,0 +1,249 @@
+#include "feature_rtree.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <limits>
+#include <numeric>
+#include <protozero/pbf_message.hpp>
+#include <vtzero/geometry.hpp>
+
+namespace VectorTileQuery {
+
+namespace {
+
+/// vtzero geometry handler collecting the bounding box of all points
+class box_handler {
+  public:
+    void points_begin(std::uint32_t /*count*/) {}
+    void points_point(vtzero::point const& pt) {
+        add(pt);
+    }
+    void points_end() {}
+
+    void linestring_begin(std::uint32_t /*count*/) {}
+    void linestring_point(vtzero::point const& pt) {
+        add(pt);
+    }
+    void linestring_end() {}
+
+    void ring_begin(std::uint32_t /*count*/) {}
+    void ring_point(vtzero::point const& pt) {
+        add(pt);
+    }
+    void ring_end(vtzero::ring_type /*type*/) {}
+
+    /// empty (min > max) if there were no points
+    feature_rtree::box const& result() const {
+        return box_;
+    }
+
+  private:
+    void add(vtzero::point const& pt) {
+        box_.min_x = std::min(box_.min_x, pt.x);
+        box_.min_y = std::min(box_.min_y, pt.y);
+        box_.max_x = std::max(box_.max_x, pt.x);
+        box_.max_y = std::max(box_.max_y, pt.y);
+    }
+
+    feature_rtree::box box_{std::numeric_limits<std::int32_t>::max(),
+                            std::numeric_limits<std::int32_t>::max(),
+                            std::numeric_limits<std::int32_t>::min(),
+                            std::numeric_limits<std::int32_t>::min()};
+};
+
+feature_rtree::box feature_box(vtzero::layer const& layer, vtzero::data_view data) {
+    try {
+        vtzero::feature const feature{&layer, data};
+        box_handler handler;
+        vtzero::decode_geometry(feature.geometry(), handler);
+        return handler.result();
+    } catch (std::exception const& /*e*/) {
+        return {std::numeric_limits<std::int32_t>::min(),
+                std::numeric_limits<std::int32_t>::min(),
+                std::numeric_limits<std::int32_t>::max(),
+                std::numeric_limits<std::int32_t>::max()};
+    }
+}
+
+/// position of (x, y) along a Hilbert curve over 16 bit coordinates (ported from flatbush)
+std::uint32_t hilbert(std::uint32_t x, std::uint32_t y) {
+    std::uint32_t a = x ^ y;
+    std::uint32_t b = 0xFFFFU ^ a;
+    std::uint32_t c = 0xFFFFU ^ (x | y);
+    std::uint32_t d = x & (y ^ 0xFFFFU);
+
+    std::uint32_t A = a | (b >> 1U);
+    std::uint32_t B = (a >> 1U) ^ a;
+    std::uint32_t C = ((c >> 1U) ^ (b & (d >> 1U))) ^ c;
+    std::uint32_t D = ((a & (c >> 1U)) ^ (d >> 1U)) ^ d;
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = ((a & (a >> 2U)) ^ (b & (b >> 2U)));
+    B = ((a & (b >> 2U)) ^ (b & ((a ^ b) >> 2U)));
+    C ^= ((a & (c >> 2U)) ^ (b & (d >> 2U)));
+    D ^= ((b & (c >> 2U)) ^ ((a ^ b) & (d >> 2U)));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    A = ((a & (a >> 4U)) ^ (b & (b >> 4U)));
+    B = ((a & (b >> 4U)) ^ (b & ((a ^ b) >> 4U)));
+    C ^= ((a & (c >> 4U)) ^ (b & (d >> 4U)));
+    D ^= ((b & (c >> 4U)) ^ ((a ^ b) & (d >> 4U)));
+
+    a = A;
+    b = B;
+    c = C;
+    d = D;
+    C ^= ((a & (c >> 8U)) ^ (b & (d >> 8U)));
+    D ^= ((b & (c >> 8U)) ^ ((a ^ b) & (d >> 8U)));
+
+    a = C ^ (C >> 1U);
+    b = D ^ (D >> 1U);
+
+    std::uint32_t i0 = x ^ y;
+    std::uint32_t i1 = b | (0xFFFFU ^ (i0 | a));
+
+    i0 = (i0 | (i0 << 8U)) & 0x00FF00FFU;
+    i0 = (i0 | (i0 << 4U)) & 0x0F0F0F0FU;
+    i0 = (i0 | (i0 << 2U)) & 0x33333333U;
+    i0 = (i0 | (i0 << 1U)) & 0x55555555U;
+
+    i1 = (i1 | (i1 << 8U)) & 0x00FF00FFU;
+    i1 = (i1 | (i1 << 4U)) & 0x0F0F0F0FU;
+    i1 = (i1 | (i1 << 2U)) & 0x33333333U;
+    i1 = (i1 | (i1 << 1U)) & 0x55555555U;
+
+    return (i1 << 1U) | i0;
+}
+
+/// map a coordinate to 16 bits, relative to the range of all box centers
+std::uint32_t scale(double value, double min, double size) {
+    double const scaled = size > 0.0 ? std::floor(65535.0 * (value - min) / size) : 0.0;
+    return static_cast<std::uint32_t>(std::min(std::max(scaled, 0.0), 65535.0));
+}
+
+double center(std::int32_t min, std::int32_t max) {
+    return (static_cast<double>(min) + static_cast<double>(max)) / 2.0;
+}
+
+} // namespace
+
+feature_rtree::feature_rtree(vtzero::layer const& layer) {
+    features_.reserve(layer.num_features());
+    protozero::pbf_message<vtzero::detail::pbf_layer> reader{layer.data()};
+    while (reader.next(vtzero::detail::pbf_layer::features, protozero::pbf_wire_type::length_delimited)) {
+        features_.push_back(reader.get_view());
+    }
+    std::size_t const num_features = features_.size();
+    if (num_features == 0) {
+        return;
+    }
+
+    std::vector<box> leaves;
+    leaves.reserve(num_features);
+    double min_x = std::numeric_limits<double>::max();
+    double min_y = std::numeric_limits<double>::max();
+    double max_x = std::numeric_limits<double>::lowest();
+    double max_y = std::numeric_limits<double>::lowest();
+    for (auto const& data : features_) {
+        leaves.push_back(feature_box(layer, data));
+        box const& b = leaves.back();
+        if (b.min_x <= b.max_x) {
+            min_x = std::min(min_x, center(b.min_x, b.max_x));
+            min_y = std::min(min_y, center(b.min_y, b.max_y));
+            max_x = std::max(max_x, center(b.min_x, b.max_x));
+            max_y = std::max(max_y, center(b.min_y, b.max_y));
+        }
+    }
+
+    // sort the leaves along the Hilbert curve through their centers
+    std::vector<std::uint32_t> hilbert_values(num_features);
+    for (std::size_t i = 0; i < num_features; ++i) {
+        box const& b = leaves[i];
+        hilbert_values[i] = hilbert(scale(center(b.min_x, b.max_x), min_x, max_x - min_x),
+                                    scale(center(b.min_y, b.max_y), min_y, max_y - min_y));
+    }
+    std::vector<std::uint32_t> order(num_features);
+    std::iota(order.begin(), order.end(), 0U);
+    std::stable_sort(order.begin(), order.end(), [&hilbert_values](std::uint32_t a, std::uint32_t b) {
+        return hilbert_values[a] < hilbert_values[b];
+    });
+
+    // the size of every level, up to a single root node
+    std::size_t level_size = num_features;
+    std::size_t total = num_features;
+    level_bounds_.push_back(total);
+    do {
+        level_size = (level_size + node_size - 1) / node_size;
+        total += level_size;
+        level_bounds_.push_back(total);
+    } while (level_size != 1);
+
+    boxes_.reserve(total);
+    indices_.reserve(total);
+    for (std::uint32_t const feature : order) {
+        boxes_.push_back(leaves[feature]);
+        indices_.push_back(feature);
+    }
+    // every node covers the `node_size` entries of the level below it
+    std::size_t begin = 0;
+    for (std::size_t level = 0; level + 1 < level_bounds_.size(); ++level) {
+        std::size_t const end = level_bounds_[level];
+        for (std::size_t first = begin; first < end; first += node_size) {
+            box node = boxes_[first];
+            for (std::size_t i = first + 1; i < std::min(first + node_size, end); ++i) {
+                node.min_x = std::min(node.min_x, boxes_[i].min_x);
+                node.min_y = std::min(node.min_y, boxes_[i].min_y);
+                node.max_x = std::max(node.max_x, boxes_[i].max_x);
+                node.max_y = std::max(node.max_y, boxes_[i].max_y);
+            }
+            boxes_.push_back(node);
+            indices_.push_back(static_cast<std::uint32_t>(first));
+        }
+        begin = end;
+    }
+}
+
+void feature_rtree::search(double qx, double qy, double max_distance, std::vector<hit>& hits) const {
+    if (boxes_.empty()) {
+        return;
+    }
+    bool const bounded = max_distance < std::numeric_limits<double>::infinity();
+    double const max_squared_distance = max_distance * max_distance;
+
+    // nodes still to look into: their first entry and the level of their entries
+    std::vector<std::pair<std::size_t, std::size_t>> stack;
+    std::size_t first = boxes_.size() - 1;
+    std::size_t level = level_bounds_.size() - 1;
+    while (true) {
+        std::size_t const end = std::min(first + node_size, level_bounds_[level]);
+        for (std::size_t i = first; i < end; ++i) {
+            box const& b = boxes_[i];
+            double const dx = std::max({b.min_x - qx, 0.0, qx - b.max_x});
+            double const dy = std::max({b.min_y - qy, 0.0, qy - b.max_y});
+            double const squared_distance = dx * dx + dy * dy;
+            if (bounded && squared_distance > max_squared_distance) {
+                continue;
+            }
+            if (level == 0) {
+                hits.push_back(hit{indices_[i], squared_distance});
+            } else {
+                stack.emplace_back(indices_[i], level - 1);
+            }
+        }
+        if (stack.empty()) {
+            break;
+        }
+        first = stack.back().first;
+        level = stack.back().second;
+        stack.pop_back();
+    }
+}
+
+} // namespace VectorTileQuery
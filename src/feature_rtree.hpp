@@ -0,0 +1,79 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vtzero/vector_tile.hpp>
+
+namespace VectorTileQuery {
+
+/*
+  Packed static R-tree of the bounding boxes (in tile coordinates) of the features of a layer.
+
+  It is laid out like flatbush (https://github.com/mourner/flatbush): the boxes are sorted
+  along a Hilbert curve and packed into nodes of `node_size`, and all of it is stored in
+  flat arrays, the leaves first and then every level of nodes up to the root.
+
+  Features whose geometry can not be decoded get a box that covers everything, so they are
+  always visited and fail (or not) the same way they do without the index.
+*/
+class feature_rtree {
+  public:
+    static constexpr std::size_t node_size = 16;
+
+    struct box {
+        std::int32_t min_x;
+        std::int32_t min_y;
+        std::int32_t max_x;
+        std::int32_t max_y;
+    };
+
+    /// a feature whose box is within reach, and the squared distance of its box
+    struct hit {
+        std::uint32_t feature;
+        double squared_distance;
+    };
+
+    /// decode the geometry of every feature of the layer and pack their boxes
+    explicit feature_rtree(vtzero::layer const& layer);
+
+    std::size_t size() const {
+        return features_.size();
+    }
+
+    /// encoded data of a feature, in the order of the layer
+    vtzero::data_view feature(std::size_t index) const {
+        return features_[index];
+    }
+
+    /// add the features whose box is within `max_distance` of the query point to `hits`,
+    /// in no particular order
+    void search(double qx, double qy, double max_distance, std::vector<hit>& hits) const;
+
+  private:
+    std::vector<vtzero::data_view> features_;
+    // leaves (one per feature) and then the nodes of every level, the root is last
+    std::vector<box> boxes_;
+    // feature of a leaf, or the position of the first child of a node
+    std::vector<std::uint32_t> indices_;
+    // end of every level in boxes_, the leaves first
+    std::vector<std::size_t> level_bounds_;
+};
+
+/// feature_rtree of a layer, built by the first query that needs it, while any others wait for it
+class lazy_feature_rtree {
+  public:
+    feature_rtree const& get(vtzero::layer const& layer) const {
+        std::call_once(once_, [this, &layer] {
+            tree_ = std::make_unique<feature_rtree>(layer);
+        });
+        return *tree_;
+    }
+
+  private:
+    mutable std::once_flag once_;
+    mutable std::unique_ptr<feature_rtree> tree_;
+};
+
+} // namespace VectorTileQuery
@@ -1,3 +1,4 @@
+#include "vector_tile_handle.hpp"
 #include "vtquery.hpp"
 #include <nan.h>
 // #include "your_code.hpp"
@@ -5,6 +6,13 @@
 static void init(v8::Local<v8::Object> target) {
     // expose helloAsync method
     Nan::SetMethod(target, "vtquery", VectorTileQuery::vtquery);
+    Nan::SetMethod(target, "batch", VectorTileQuery::batch);
+    Nan::SetMethod(target, "join", VectorTileQuery::join);
+    Nan::SetMethod(target, "setCacheSize", VectorTileQuery::setCacheSize);
+    Nan::SetMethod(target, "cacheStats", VectorTileQuery::cacheStats);
+    Nan::SetMethod(target, "addZstdDictionary", VectorTileQuery::addZstdDictionary);
+    Nan::SetMethod(target, "instructionSet", VectorTileQuery::instructionSet);
+    VectorTileQuery::VectorTileHandle::Init(target);
 }
 
 NODE_MODULE(module, init) // NOLINT
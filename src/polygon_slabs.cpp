@@ -0,0 +1,168 @@
+#include "polygon_slabs.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace VectorTileQuery {
+
+namespace {
+
+// about this many edges per slab, and at most `max_slabs` slabs
+constexpr std::size_t edges_per_slab = 8;
+constexpr std::size_t max_slabs = 4096;
+
+/// vtzero geometry handler collecting the edges of the rings, grouped into polygons like direct_hit_handler does it
+template <typename Edge>
+class edge_handler {
+  public:
+    edge_handler(std::vector<Edge>& edges, std::uint32_t no_polygon)
+        : edges_(edges),
+          polygon_(no_polygon) {}
+
+    void points_begin(std::uint32_t /*count*/) {}
+    void points_point(vtzero::point const& /*pt*/) {}
+    void points_end() {}
+
+    void linestring_begin(std::uint32_t /*count*/) {}
+    void linestring_point(vtzero::point const& /*pt*/) {}
+    void linestring_end() {}
+
+    void ring_begin(std::uint32_t /*count*/) {
+        ring_.clear();
+    }
+
+    void ring_point(vtzero::point const& pt) {
+        ring_.push_back(pt);
+    }
+
+    void ring_end(vtzero::ring_type type) {
+        // an outer ring starts a new polygon, the polygon is only known once the ring is done
+        if (type == vtzero::ring_type::outer) {
+            ++polygon_;
+        }
+        for (std::size_t i = 1; i < ring_.size(); ++i) {
+            edges_.push_back(Edge{ring_[i - 1], ring_[i], polygon_});
+        }
+    }
+
+  private:
+    std::vector<Edge>& edges_;
+    std::vector<vtzero::point> ring_;
+    // wraps around to 0 with the first outer ring
+    std::uint32_t polygon_;
+};
+
+} // namespace
+
+polygon_slabs::polygon_slabs(vtzero::feature const& feature) {
+    geometry_.decode(feature);
+    std::vector<edge> edges;
+    edge_handler<edge> handler{edges, no_polygon};
+    geometry_.replay(handler);
+    if (edges.empty()) {
+        offsets_.assign(2, 0);
+        return;
+    }
+
+    std::size_t const num_slabs = std::max<std::size_t>(1, std::min(max_slabs, edges.size() / edges_per_slab));
+    min_y_ = geometry_.min_y();
+    slab_height_ = std::max(1.0, std::ceil((static_cast<double>(geometry_.max_y()) - min_y_ + 1.0) / static_cast<double>(num_slabs)));
+
+    // an edge is in every slab its y range overlaps, count them first and then fill them in ring order
+    offsets_.assign(num_slabs + 1, 0);
+    for (auto const& e : edges) {
+        std::size_t const last = slab(std::max(e.a.y, e.b.y));
+        for (std::size_t s = slab(std::min(e.a.y, e.b.y)); s <= last; ++s) {
+            ++offsets_[s + 1];
+        }
+    }
+    for (std::size_t s = 1; s < offsets_.size(); ++s) {
+        offsets_[s] += offsets_[s - 1];
+    }
+    edges_.resize(offsets_.back());
+    std::vector<std::size_t> next(offsets_.begin(), offsets_.end() - 1);
+    for (auto const& e : edges) {
+        std::size_t const last = slab(std::max(e.a.y, e.b.y));
+        for (std::size_t s = slab(std::min(e.a.y, e.b.y)); s <= last; ++s) {
+            edges_[next[s]++] = e;
+        }
+    }
+}
+
+std::size_t polygon_slabs::slab(double y) const {
+    double const s = std::floor((y - min_y_) / slab_height_);
+    if (!(s > 0.0)) {
+        return 0;
+    }
+    double const last = static_cast<double>(offsets_.size() - 2);
+    return s < last ? static_cast<std::size_t>(s) : static_cast<std::size_t>(last);
+}
+
+bool polygon_slabs::contains(mapbox::geometry::point<std::int64_t> const& query_point) const {
+    double const qx = static_cast<double>(query_point.x);
+    double const qy = static_cast<double>(query_point.y);
+    // no edge spans a y outside of the bounding box
+    if (geometry_.empty() || qy < geometry_.min_y() || qy >= geometry_.max_y()) {
+        return false;
+    }
+    std::size_t const s = slab(qy);
+    bool inside = false;
+    std::uint32_t polygon = no_polygon;
+    for (std::size_t i = offsets_[s]; i < offsets_[s + 1]; ++i) {
+        edge const& e = edges_[i];
+        if (e.polygon == no_polygon) {
+            continue;
+        }
+        if (e.polygon != polygon) {
+            if (inside) {
+                return true;
+            }
+            polygon = e.polygon;
+        }
+        if (detail::crosses(qx, qy, e.a, e.b)) {
+            inside = !inside;
+        }
+    }
+    return inside;
+}
+
+bool polygon_slabs::near(mapbox::geometry::point<std::int64_t> const& query_point, double near_distance) const {
+    double const qx = static_cast<double>(query_point.x);
+    double const qy = static_cast<double>(query_point.y);
+    if (geometry_.squared_distance(query_point) > near_distance * near_distance) {
+        return false;
+    }
+    double const near_squared_distance = near_distance * near_distance;
+    std::size_t const last = slab(qy + near_distance);
+    for (std::size_t s = slab(qy - near_distance); s <= last; ++s) {
+        for (std::size_t i = offsets_[s]; i < offsets_[s + 1]; ++i) {
+            edge const& e = edges_[i];
+            if (qx + near_distance < std::min(e.a.x, e.b.x) || qx - near_distance > std::max(e.a.x, e.b.x) ||
+                qy + near_distance < std::min(e.a.y, e.b.y) || qy - near_distance > std::max(e.a.y, e.b.y)) {
+                continue;
+            }
+            double x;
+            double y;
+            if (detail::closest_on_segment(qx, qy, e.a, e.b, x, y) <= near_squared_distance) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+mapbox::geometry::algorithms::closest_point_info slabs_direct_hit(polygon_slabs const& slabs,
+                                                                  mapbox::geometry::point<std::int64_t> const& query_point,
+                                                                  double near_distance) {
+    if (slabs.contains(query_point)) {
+        return mapbox::geometry::algorithms::closest_point_info{static_cast<double>(query_point.x), static_cast<double>(query_point.y), 0.0};
+    }
+    // rare, the closest point is measured over the whole geometry so it is the same as without slabs
+    if (slabs.near(query_point, near_distance)) {
+        return feature_closest_point(slabs.geometry(), query_point, near_distance);
+    }
+    return mapbox::geometry::algorithms::closest_point_info{};
+}
+
+} // namespace VectorTileQuery
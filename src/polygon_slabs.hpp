@@ -0,0 +1,101 @@
+#pragma once
+#include "closest_point.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <vtzero/vector_tile.hpp>
+
+namespace VectorTileQuery {
+
+/*
+  The edges of the rings of a polygon feature, bucketed into horizontal slabs of its bounding
+  box. A ray from the query point towards +x can only cross the edges that span its y, and all
+  of those are in the slab of the query point, so the crossing number test only walks that slab
+  instead of every edge of the feature.
+
+  Edges keep the order of the rings and the polygon (an outer ring and the rings after it) they
+  belong to, so the test is the same as the one of direct_hit_handler.
+*/
+class polygon_slabs {
+  public:
+    /// features with less encoded geometry than this are tested directly, it is not worth it
+    static constexpr std::size_t min_geometry_bytes = 1024;
+
+    /// decode the rings of a polygon feature, vtzero throws if its geometry is not valid
+    explicit polygon_slabs(vtzero::feature const& feature);
+
+    /// is the query point within any of the polygons
+    bool contains(mapbox::geometry::point<std::int64_t> const& query_point) const;
+
+    /// is any edge within `near_distance` of the query point
+    bool near(mapbox::geometry::point<std::int64_t> const& query_point, double near_distance) const;
+
+    decoded_geometry const& geometry() const {
+        return geometry_;
+    }
+
+  private:
+    struct edge {
+        vtzero::point a;
+        vtzero::point b;
+        // the polygon of the ring, or no_polygon for rings before the first outer ring
+        std::uint32_t polygon;
+    };
+
+    static constexpr std::uint32_t no_polygon = 0xffffffffU;
+
+    /// the slab of a y coordinate, clamped to the slabs
+    std::size_t slab(double y) const;
+
+    decoded_geometry geometry_;
+    double min_y_ = 0.0;
+    double slab_height_ = 1.0;
+    // the edges of slab s are edges_[offsets_[s]] to edges_[offsets_[s + 1] - 1], in ring order
+    std::vector<std::size_t> offsets_;
+    std::vector<edge> edges_;
+};
+
+/// direct hit test (see feature_direct_hit) of the polygon feature the slabs were built for
+mapbox::geometry::algorithms::closest_point_info slabs_direct_hit(polygon_slabs const& slabs,
+                                                                  mapbox::geometry::point<std::int64_t> const& query_point,
+                                                                  double near_distance);
+
+/*
+  polygon_slabs of the large polygons of a layer, each built by the first query that tests it,
+  while any others wait for it. Nothing is allocated until the first large polygon is tested.
+*/
+class lazy_polygon_slabs {
+  public:
+    explicit lazy_polygon_slabs(std::size_t num_features)
+        : num_features_(num_features) {}
+
+    /// the slabs of the polygon feature `feature_index` of the layer, or nullptr if it is small
+    polygon_slabs const* get(std::uint64_t feature_index, vtzero::feature const& feature) const {
+        if (feature.geometry().data().size() < polygon_slabs::min_geometry_bytes || feature_index >= num_features_) {
+            return nullptr;
+        }
+        std::call_once(once_, [this] {
+            slots_.reset(new slot[num_features_]);
+        });
+        slot& s = slots_[feature_index];
+        std::call_once(s.once, [&s, &feature] {
+            s.slabs = std::make_unique<polygon_slabs>(feature);
+        });
+        return s.slabs.get();
+    }
+
+  private:
+    struct slot {
+        std::once_flag once;
+        std::unique_ptr<polygon_slabs> slabs;
+    };
+
+    std::size_t num_features_;
+    mutable std::once_flag once_;
+    mutable std::unique_ptr<slot[]> slots_;
+};
+
+} // namespace VectorTileQuery
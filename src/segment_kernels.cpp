@@ -0,0 +1,299 @@
+#include "segment_kernels.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define VTQUERY_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace VectorTileQuery {
+namespace kernels {
+
+namespace {
+
+using closest_segment_fn = std::size_t (*)(segment_point const*, std::size_t, double, double, double&);
+using odd_crossings_fn = bool (*)(segment_point const*, std::size_t, double, double);
+
+/// keeps the first segment with the smallest distance, from `first` on
+std::size_t closest_segment_tail(segment_point const* points, std::size_t count, double qx, double qy,
+                                 std::size_t first, std::size_t best_index, double& best) {
+    for (std::size_t i = first; i + 1 < count; ++i) {
+        double x;
+        double y;
+        double const squared_distance = detail::closest_on_segment(qx, qy, points[i], points[i + 1], x, y);
+        if (squared_distance < best) {
+            best = squared_distance;
+            best_index = i;
+        }
+    }
+    return best_index;
+}
+
+bool odd_crossings_tail(segment_point const* points, std::size_t count, double qx, double qy, std::size_t first, bool odd) {
+    for (std::size_t i = first; i + 1 < count; ++i) {
+        if (detail::crosses(qx, qy, points[i], points[i + 1])) {
+            odd = !odd;
+        }
+    }
+    return odd;
+}
+
+std::size_t closest_segment_scalar(segment_point const* points, std::size_t count, double qx, double qy, double& squared_distance) {
+    squared_distance = std::numeric_limits<double>::infinity();
+    return closest_segment_tail(points, count, qx, qy, 0, 0, squared_distance);
+}
+
+bool odd_crossings_scalar(segment_point const* points, std::size_t count, double qx, double qy) {
+    return odd_crossings_tail(points, count, qx, qy, 0, false);
+}
+
+#ifdef VTQUERY_X86_KERNELS
+
+/// the smallest distance of the lanes, the lowest index on ties
+template <std::size_t N>
+std::size_t reduce_lanes(double const (&distances)[N], double const (&indexes)[N], double& best) {
+    std::size_t best_index = 0;
+    best = std::numeric_limits<double>::infinity();
+    for (std::size_t lane = 0; lane < N; ++lane) {
+        auto const index = static_cast<std::size_t>(indexes[lane]);
+        if (distances[lane] < best || (!(distances[lane] > best) && index < best_index)) {
+            best = distances[lane];
+            best_index = index;
+        }
+    }
+    return best_index;
+}
+
+// 4 segments at a time: points i..i+3 are the starts, points i+1..i+4 the ends
+
+__attribute__((target("avx2"))) void load_avx2(segment_point const* points, __m256d& x, __m256d& y) {
+    __m256i const deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i const xy = _mm256_permutevar8x32_epi32(_mm256_loadu_si256(reinterpret_cast<__m256i const*>(points)), deinterleave);
+    x = _mm256_cvtepi32_pd(_mm256_castsi256_si128(xy));
+    y = _mm256_cvtepi32_pd(_mm256_extracti128_si256(xy, 1));
+}
+
+__attribute__((target("avx2"))) std::size_t closest_segment_avx2(segment_point const* points, std::size_t count, double qx, double qy, double& squared_distance) {
+    std::size_t const segments = count - 1;
+    if (segments < 4) {
+        return closest_segment_scalar(points, count, qx, qy, squared_distance);
+    }
+    __m256d const vqx = _mm256_set1_pd(qx);
+    __m256d const vqy = _mm256_set1_pd(qy);
+    __m256d const zero = _mm256_setzero_pd();
+    __m256d const one = _mm256_set1_pd(1.0);
+    __m256d const four = _mm256_set1_pd(4.0);
+    __m256d best = _mm256_set1_pd(std::numeric_limits<double>::infinity());
+    __m256d best_index = zero;
+    __m256d index = _mm256_setr_pd(0.0, 1.0, 2.0, 3.0);
+    std::size_t i = 0;
+    for (; i + 4 <= segments; i += 4) {
+        __m256d x0;
+        __m256d y0;
+        __m256d x1;
+        __m256d y1;
+        load_avx2(points + i, x0, y0);
+        load_avx2(points + i + 1, x1, y1);
+        __m256d const dx = _mm256_sub_pd(x1, x0);
+        __m256d const dy = _mm256_sub_pd(y1, y0);
+        __m256d const length_squared = _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy));
+        __m256d t = _mm256_div_pd(_mm256_add_pd(_mm256_mul_pd(_mm256_sub_pd(vqx, x0), dx), _mm256_mul_pd(_mm256_sub_pd(vqy, y0), dy)), length_squared);
+        t = _mm256_blendv_pd(t, zero, _mm256_cmp_pd(t, zero, _CMP_LT_OQ));
+        t = _mm256_blendv_pd(t, one, _mm256_cmp_pd(t, one, _CMP_GT_OQ));
+        t = _mm256_and_pd(t, _mm256_cmp_pd(length_squared, zero, _CMP_GT_OQ));
+        __m256d const ex = _mm256_sub_pd(_mm256_add_pd(x0, _mm256_mul_pd(t, dx)), vqx);
+        __m256d const ey = _mm256_sub_pd(_mm256_add_pd(y0, _mm256_mul_pd(t, dy)), vqy);
+        __m256d const distance = _mm256_add_pd(_mm256_mul_pd(ex, ex), _mm256_mul_pd(ey, ey));
+        __m256d const closer = _mm256_cmp_pd(distance, best, _CMP_LT_OQ);
+        best = _mm256_blendv_pd(best, distance, closer);
+        best_index = _mm256_blendv_pd(best_index, index, closer);
+        index = _mm256_add_pd(index, four);
+    }
+    double distances[4];
+    double indexes[4];
+    _mm256_storeu_pd(distances, best);
+    _mm256_storeu_pd(indexes, best_index);
+    // the compiler does not reliably clear the upper halves for functions with a target attribute,
+    // and leaving them dirty slows down the SSE code that follows
+    _mm256_zeroupper();
+    std::size_t const lane_index = reduce_lanes(distances, indexes, squared_distance);
+    return closest_segment_tail(points, count, qx, qy, i, lane_index, squared_distance);
+}
+
+__attribute__((target("avx2"))) bool odd_crossings_avx2(segment_point const* points, std::size_t count, double qx, double qy) {
+    std::size_t const segments = count - 1;
+    __m256d const vqx = _mm256_set1_pd(qx);
+    __m256d const vqy = _mm256_set1_pd(qy);
+    int crossings = 0;
+    std::size_t i = 0;
+    for (; i + 4 <= segments; i += 4) {
+        __m256d x0;
+        __m256d y0;
+        __m256d x1;
+        __m256d y1;
+        load_avx2(points + i, x0, y0);
+        load_avx2(points + i + 1, x1, y1);
+        __m256d const spans = _mm256_xor_pd(_mm256_cmp_pd(y0, vqy, _CMP_GT_OQ), _mm256_cmp_pd(y1, vqy, _CMP_GT_OQ));
+        __m256d const lhs = _mm256_mul_pd(_mm256_sub_pd(vqx, x0), _mm256_sub_pd(y1, y0));
+        __m256d const rhs = _mm256_mul_pd(_mm256_sub_pd(x1, x0), _mm256_sub_pd(vqy, y0));
+        __m256d const side = _mm256_blendv_pd(_mm256_cmp_pd(lhs, rhs, _CMP_GT_OQ), _mm256_cmp_pd(lhs, rhs, _CMP_LT_OQ), _mm256_cmp_pd(y1, y0, _CMP_GT_OQ));
+        crossings += __builtin_popcount(static_cast<unsigned>(_mm256_movemask_pd(_mm256_and_pd(spans, side))));
+    }
+    _mm256_zeroupper();
+    return odd_crossings_tail(points, count, qx, qy, i, (crossings & 1) != 0);
+}
+
+// 2 segments at a time: points i..i+1 are the starts, points i+1..i+2 the ends
+
+__attribute__((target("sse4.2"))) void load_sse42(segment_point const* points, __m128d& x, __m128d& y) {
+    __m128i const xy = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<__m128i const*>(points)), _MM_SHUFFLE(3, 1, 2, 0));
+    x = _mm_cvtepi32_pd(xy);
+    y = _mm_cvtepi32_pd(_mm_unpackhi_epi64(xy, xy));
+}
+
+__attribute__((target("sse4.2"))) std::size_t closest_segment_sse42(segment_point const* points, std::size_t count, double qx, double qy, double& squared_distance) {
+    std::size_t const segments = count - 1;
+    if (segments < 2) {
+        return closest_segment_scalar(points, count, qx, qy, squared_distance);
+    }
+    __m128d const vqx = _mm_set1_pd(qx);
+    __m128d const vqy = _mm_set1_pd(qy);
+    __m128d const zero = _mm_setzero_pd();
+    __m128d const one = _mm_set1_pd(1.0);
+    __m128d const two = _mm_set1_pd(2.0);
+    __m128d best = _mm_set1_pd(std::numeric_limits<double>::infinity());
+    __m128d best_index = zero;
+    __m128d index = _mm_setr_pd(0.0, 1.0);
+    std::size_t i = 0;
+    for (; i + 2 <= segments; i += 2) {
+        __m128d x0;
+        __m128d y0;
+        __m128d x1;
+        __m128d y1;
+        load_sse42(points + i, x0, y0);
+        load_sse42(points + i + 1, x1, y1);
+        __m128d const dx = _mm_sub_pd(x1, x0);
+        __m128d const dy = _mm_sub_pd(y1, y0);
+        __m128d const length_squared = _mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy));
+        __m128d t = _mm_div_pd(_mm_add_pd(_mm_mul_pd(_mm_sub_pd(vqx, x0), dx), _mm_mul_pd(_mm_sub_pd(vqy, y0), dy)), length_squared);
+        t = _mm_blendv_pd(t, zero, _mm_cmplt_pd(t, zero));
+        t = _mm_blendv_pd(t, one, _mm_cmpgt_pd(t, one));
+        t = _mm_and_pd(t, _mm_cmpgt_pd(length_squared, zero));
+        __m128d const ex = _mm_sub_pd(_mm_add_pd(x0, _mm_mul_pd(t, dx)), vqx);
+        __m128d const ey = _mm_sub_pd(_mm_add_pd(y0, _mm_mul_pd(t, dy)), vqy);
+        __m128d const distance = _mm_add_pd(_mm_mul_pd(ex, ex), _mm_mul_pd(ey, ey));
+        __m128d const closer = _mm_cmplt_pd(distance, best);
+        best = _mm_blendv_pd(best, distance, closer);
+        best_index = _mm_blendv_pd(best_index, index, closer);
+        index = _mm_add_pd(index, two);
+    }
+    double distances[2];
+    double indexes[2];
+    _mm_storeu_pd(distances, best);
+    _mm_storeu_pd(indexes, best_index);
+    std::size_t const lane_index = reduce_lanes(distances, indexes, squared_distance);
+    return closest_segment_tail(points, count, qx, qy, i, lane_index, squared_distance);
+}
+
+__attribute__((target("sse4.2"))) bool odd_crossings_sse42(segment_point const* points, std::size_t count, double qx, double qy) {
+    std::size_t const segments = count - 1;
+    __m128d const vqx = _mm_set1_pd(qx);
+    __m128d const vqy = _mm_set1_pd(qy);
+    int crossings = 0;
+    std::size_t i = 0;
+    for (; i + 2 <= segments; i += 2) {
+        __m128d x0;
+        __m128d y0;
+        __m128d x1;
+        __m128d y1;
+        load_sse42(points + i, x0, y0);
+        load_sse42(points + i + 1, x1, y1);
+        __m128d const spans = _mm_xor_pd(_mm_cmpgt_pd(y0, vqy), _mm_cmpgt_pd(y1, vqy));
+        __m128d const lhs = _mm_mul_pd(_mm_sub_pd(vqx, x0), _mm_sub_pd(y1, y0));
+        __m128d const rhs = _mm_mul_pd(_mm_sub_pd(x1, x0), _mm_sub_pd(vqy, y0));
+        __m128d const side = _mm_blendv_pd(_mm_cmpgt_pd(lhs, rhs), _mm_cmplt_pd(lhs, rhs), _mm_cmpgt_pd(y1, y0));
+        crossings += __builtin_popcount(static_cast<unsigned>(_mm_movemask_pd(_mm_and_pd(spans, side))));
+    }
+    return odd_crossings_tail(points, count, qx, qy, i, (crossings & 1) != 0);
+}
+
+#endif
+
+struct kernel_set {
+    closest_segment_fn closest_segment;
+    odd_crossings_fn odd_crossings;
+    char const* instruction_set;
+};
+
+// from the best to the worst
+char const* const instruction_sets[] = {"avx2", "sse4.2", "scalar"};
+
+/// the instruction set named by VTQUERY_INSTRUCTION_SET, or nullptr (the best one) if it names none
+char const* forced_instruction_set() {
+    char const* const name = std::getenv("VTQUERY_INSTRUCTION_SET");
+    if (name != nullptr) {
+        for (char const* set : instruction_sets) {
+            if (std::strcmp(set, name) == 0) {
+                return set;
+            }
+        }
+    }
+    return nullptr;
+}
+
+/// can the kernels for `name` be picked when `forced` is forced, they have to come after it
+bool allowed(char const* forced, char const* name) {
+    if (forced == nullptr) {
+        return true;
+    }
+    for (char const* set : instruction_sets) {
+        if (std::strcmp(set, forced) == 0) {
+            return true;
+        }
+        if (std::strcmp(set, name) == 0) {
+            return false;
+        }
+    }
+    return false;
+}
+
+kernel_set select_kernels() {
+    // the tests and benchmarks force the instruction sets the cpu would not pick to compare them
+    char const* const forced = forced_instruction_set();
+#ifdef VTQUERY_X86_KERNELS
+    // this runs from a static initializer, before the cpu model might be initialized otherwise
+    __builtin_cpu_init();
+    if (allowed(forced, "avx2") && __builtin_cpu_supports("avx2")) {
+        return {closest_segment_avx2, odd_crossings_avx2, "avx2"};
+    }
+    if (allowed(forced, "sse4.2") && __builtin_cpu_supports("sse4.2")) {
+        return {closest_segment_sse42, odd_crossings_sse42, "sse4.2"};
+    }
+#else
+    (void)forced;
+#endif
+    return {closest_segment_scalar, odd_crossings_scalar, "scalar"};
+}
+
+// picked once when the module is loaded
+kernel_set const selected_kernels = select_kernels();
+
+} // namespace
+
+std::size_t closest_segment(segment_point const* points, std::size_t count, double qx, double qy, double& squared_distance) {
+    return selected_kernels.closest_segment(points, count, qx, qy, squared_distance);
+}
+
+bool odd_crossings(segment_point const* points, std::size_t count, double qx, double qy) {
+    return selected_kernels.odd_crossings(points, count, qx, qy);
+}
+
+char const* instruction_set() {
+    return selected_kernels.instruction_set;
+}
+
+} // namespace kernels
+} // namespace VectorTileQuery
@@ -0,0 +1,72 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace VectorTileQuery {
+
+namespace detail {
+
+/// closest point (x, y) on the segment a-b to the query point, returns its squared distance
+template <typename Point>
+double closest_on_segment(double qx, double qy, Point const& a, Point const& b, double& x, double& y) {
+    double const x0 = a.x;
+    double const y0 = a.y;
+    double const dx = static_cast<double>(b.x) - x0;
+    double const dy = static_cast<double>(b.y) - y0;
+    double const length_squared = dx * dx + dy * dy;
+    double t = 0.0;
+    if (length_squared > 0.0) {
+        t = ((qx - x0) * dx + (qy - y0) * dy) / length_squared;
+        if (t < 0.0) {
+            t = 0.0;
+        } else if (t > 1.0) {
+            t = 1.0;
+        }
+    }
+    x = x0 + t * dx;
+    y = y0 + t * dy;
+    return (x - qx) * (x - qx) + (y - qy) * (y - qy);
+}
+
+/// crossing number test: does a ray from the query point towards +x cross the edge a-b
+template <typename Point>
+bool crosses(double qx, double qy, Point const& a, Point const& b) {
+    if ((a.y > qy) == (b.y > qy)) {
+        return false;
+    }
+    double const lhs = (qx - a.x) * (static_cast<double>(b.y) - a.y);
+    double const rhs = (static_cast<double>(b.x) - a.x) * (qy - a.y);
+    return b.y > a.y ? lhs < rhs : lhs > rhs;
+}
+
+} // namespace detail
+
+/*
+  Kernels over the segments of a run of decoded points (points[i] - points[i + 1]).
+
+  On x86 there are AVX2 and SSE4.2 versions next to the scalar one, the best one the CPU
+  supports is picked when the module is loaded. Setting VTQUERY_INSTRUCTION_SET to "sse4.2"
+  or "scalar" before loading it picks the best one up to that instead. They all use the same arithmetic as
+  detail::closest_on_segment and detail::crosses (without fused multiply-adds), so the
+  results do not depend on the instruction set.
+*/
+namespace kernels {
+
+struct segment_point {
+    std::int32_t x;
+    std::int32_t y;
+};
+
+/// index of the segment closest to the query point (the first one if there are several)
+/// and its squared distance, `count` has to be at least 2
+std::size_t closest_segment(segment_point const* points, std::size_t count, double qx, double qy, double& squared_distance);
+
+/// does a ray from the query point towards +x cross an odd number of the segments
+bool odd_crossings(segment_point const* points, std::size_t count, double qx, double qy);
+
+/// name of the instruction set the kernels were picked for: "avx2", "sse4.2" or "scalar"
+char const* instruction_set();
+
+} // namespace kernels
+
+} // namespace VectorTileQuery
@@ -0,0 +1,110 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace VectorTileQuery {
+
+namespace {
+
+/// shared by the threads working on one parallel_for, pool threads that only get to it
+/// after all indexes are handed out see that and never touch the task
+struct batch {
+    batch(std::function<void(std::size_t)> const& task0, std::size_t count0)
+        : task(task0),
+          count(count0) {}
+
+    std::function<void(std::size_t)> const& task;
+    std::size_t const count;
+    std::atomic<std::size_t> next{0};
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::size_t done = 0;
+    std::exception_ptr error;
+
+    void work() {
+        for (std::size_t index = next++; index < count; index = next++) {
+            std::exception_ptr task_error;
+            try {
+                task(index);
+            } catch (...) {
+                task_error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock{mutex};
+            if (task_error && !error) {
+                error = task_error;
+            }
+            if (++done == count) {
+                finished.notify_all();
+            }
+        }
+    }
+};
+
+} // namespace
+
+thread_pool::thread_pool(std::size_t num_threads) {
+    threads_.reserve(num_threads);
+    for (std::size_t i = 0; i < num_threads; ++i) {
+        threads_.emplace_back([this] { run(); });
+    }
+}
+
+thread_pool::~thread_pool() {
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+thread_pool& thread_pool::shared() {
+    static thread_pool pool{std::max(std::thread::hardware_concurrency(), 1U) - 1U};
+    return pool;
+}
+
+void thread_pool::parallel_for(std::size_t count, std::function<void(std::size_t)> const& task) {
+    if (count == 0) {
+        return;
+    }
+    auto shared_batch = std::make_shared<batch>(task, count);
+    std::size_t const helpers = std::min(count - 1, threads_.size());
+    if (helpers > 0) {
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+            for (std::size_t i = 0; i < helpers; ++i) {
+                jobs_.emplace_back([shared_batch] { shared_batch->work(); });
+            }
+        }
+        wake_.notify_all();
+    }
+    shared_batch->work();
+    std::unique_lock<std::mutex> lock{shared_batch->mutex};
+    shared_batch->finished.wait(lock, [&shared_batch] { return shared_batch->done == shared_batch->count; });
+    if (shared_batch->error) {
+        std::rethrow_exception(shared_batch->error);
+    }
+}
+
+void thread_pool::run() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock{mutex_};
+            wake_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (jobs_.empty()) {
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        job();
+    }
+}
+
+} // namespace VectorTileQuery
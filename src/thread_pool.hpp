@@ -0,0 +1,55 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace VectorTileQuery {
+
+/*
+  Process-wide pool of threads for the work inside a single query (the libuv
+  threadpool runs one query per thread, this spreads a query over several).
+
+  parallel_for() hands out the indexes one at a time from a shared counter, so an
+  idle thread always takes the next one, and the calling thread works on them as
+  well. It returns once every index is done, it never waits for a pool thread
+  that is still busy with another query.
+*/
+class thread_pool {
+  public:
+    explicit thread_pool(std::size_t num_threads);
+    ~thread_pool();
+
+    // non-copyable
+    thread_pool(thread_pool const&) = delete;
+    thread_pool& operator=(thread_pool const&) = delete;
+
+    // non-movable
+    thread_pool(thread_pool&&) = delete;
+    thread_pool& operator=(thread_pool&&) = delete;
+
+    /// the shared pool, with one thread less than the hardware has (the caller is the last one)
+    static thread_pool& shared();
+
+    std::size_t size() const {
+        return threads_.size();
+    }
+
+    /// run `task(0)` to `task(count - 1)` on the pool and the calling thread, and rethrow
+    /// the first exception a task threw once all of them are done
+    void parallel_for(std::size_t count, std::function<void(std::size_t)> const& task);
+
+  private:
+    void run();
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
+
+} // namespace VectorTileQuery
@@ -0,0 +1,107 @@
+#include "tile_cache.hpp"
+
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+namespace VectorTileQuery {
+
+namespace {
+
+/// hash of a run of bytes, 8 of them at a time
+std::uint64_t hash_buffer(vtzero::data_view bytes) {
+    constexpr std::uint64_t prime = 0x9e3779b97f4a7c15ULL;
+    char const* data = bytes.data();
+    std::size_t const size = bytes.size();
+    std::uint64_t hash = size * prime;
+    std::size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29U;
+    }
+    for (; i < size; ++i) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * prime;
+    }
+    hash ^= hash >> 32U;
+    return hash;
+}
+
+} // namespace
+
+tile_cache& tile_cache::shared() {
+    static tile_cache cache;
+    return cache;
+}
+
+void tile_cache::set_capacity(std::size_t capacity) {
+    std::lock_guard<std::mutex> lock{mutex_};
+    capacity_ = capacity;
+    evict_to(capacity);
+}
+
+bool tile_cache::enabled() const {
+    return capacity_ > 0;
+}
+
+std::shared_ptr<std::string const> tile_cache::find(vtzero::data_view compressed) {
+    std::uint64_t const hash = hash_buffer(compressed);
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto it = lookup(hash, compressed);
+    if (it == entries_.end()) {
+        ++misses_;
+        return nullptr;
+    }
+    ++hits_;
+    entries_.splice(entries_.begin(), entries_, it);
+    return it->decompressed;
+}
+
+void tile_cache::insert(vtzero::data_view compressed, std::shared_ptr<std::string const> decompressed) {
+    std::uint64_t const hash = hash_buffer(compressed);
+    std::size_t const bytes = compressed.size() + decompressed->size();
+    std::lock_guard<std::mutex> lock{mutex_};
+    // another query may have added it in the meantime
+    if (bytes > capacity_ || lookup(hash, compressed) != entries_.end()) {
+        return;
+    }
+    evict_to(capacity_ - bytes);
+    entries_.push_front(entry{hash, std::string(compressed.data(), compressed.size()), std::move(decompressed)});
+    index_.emplace(hash, entries_.begin());
+    bytes_ += bytes;
+}
+
+tile_cache::statistics tile_cache::stats() const {
+    std::lock_guard<std::mutex> lock{mutex_};
+    return statistics{capacity_, bytes_, entries_.size(), hits_, misses_, evictions_};
+}
+
+void tile_cache::evict_to(std::size_t capacity) {
+    while (bytes_ > capacity) {
+        entry const& last = entries_.back();
+        auto range = index_.equal_range(last.hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == std::prev(entries_.end())) {
+                index_.erase(it);
+                break;
+            }
+        }
+        bytes_ -= last.bytes();
+        entries_.pop_back();
+        ++evictions_;
+    }
+}
+
+tile_cache::entry_list::iterator tile_cache::lookup(std::uint64_t hash, vtzero::data_view compressed) {
+    auto range = index_.equal_range(hash);
+    for (auto it = range.first; it != range.second; ++it) {
+        std::string const& candidate = it->second->compressed;
+        if (candidate.size() == compressed.size() && std::memcmp(candidate.data(), compressed.data(), candidate.size()) == 0) {
+            return it->second;
+        }
+    }
+    return entries_.end();
+}
+
+} // namespace VectorTileQuery
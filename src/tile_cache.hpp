@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vtzero/types.hpp>
+
+namespace VectorTileQuery {
+
+/*
+  Process-wide cache of decompressed tiles, keyed by their compressed bytes.
+
+  Entries are found through a hash of the compressed bytes and then compared byte by
+  byte, so a hash collision can never return the wrong tile. The compressed and the
+  decompressed bytes of all entries together stay within the capacity, the least
+  recently used entries are evicted to make room. Decompressed tiles are shared, a
+  query keeps using its copy even if it is evicted in the meantime.
+
+  The capacity is 0 by default, which disables the cache.
+*/
+class tile_cache {
+  public:
+    struct statistics {
+        std::size_t capacity;
+        std::size_t bytes;
+        std::size_t entries;
+        std::uint64_t hits;
+        std::uint64_t misses;
+        std::uint64_t evictions;
+    };
+
+    tile_cache() = default;
+
+    // non-copyable
+    tile_cache(tile_cache const&) = delete;
+    tile_cache& operator=(tile_cache const&) = delete;
+
+    // non-movable
+    tile_cache(tile_cache&&) = delete;
+    tile_cache& operator=(tile_cache&&) = delete;
+
+    /// the cache shared by all queries
+    static tile_cache& shared();
+
+    /// change the capacity in bytes, evicting entries until they fit (0 disables the cache)
+    void set_capacity(std::size_t capacity);
+
+    bool enabled() const;
+
+    /// the decompressed tile, or nullptr if it is not in the cache (counts a hit or a miss)
+    std::shared_ptr<std::string const> find(vtzero::data_view compressed);
+
+    /// add a decompressed tile, unless it does not fit at all
+    void insert(vtzero::data_view compressed, std::shared_ptr<std::string const> decompressed);
+
+    statistics stats() const;
+
+  private:
+    struct entry {
+        std::uint64_t hash;
+        std::string compressed;
+        std::shared_ptr<std::string const> decompressed;
+
+        std::size_t bytes() const {
+            return compressed.size() + decompressed->size();
+        }
+    };
+    using entry_list = std::list<entry>;
+
+    void evict_to(std::size_t capacity);
+    entry_list::iterator lookup(std::uint64_t hash, vtzero::data_view compressed);
+
+    mutable std::mutex mutex_;
+    // most recently used first
+    entry_list entries_;
+    std::unordered_multimap<std::uint64_t, entry_list::iterator> index_;
+    std::atomic<std::size_t> capacity_{0};
+    std::size_t bytes_ = 0;
+    std::uint64_t hits_ = 0;
+    std::uint64_t misses_ = 0;
+    std::uint64_t evictions_ = 0;
+};
+
+} // namespace VectorTileQuery
@@ -0,0 +1,264 @@
+#include "tile_decompressor.hpp"
+
+#include <cstddef>
+#include <gzip/utils.hpp>
+#include <stdexcept>
+
+#ifdef VTQUERY_USE_LIBDEFLATE
+#include <libdeflate.h>
+#include <new>
+#endif
+
+#ifdef VTQUERY_USE_ZSTD
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <zstd.h>
+#endif
+
+namespace VectorTileQuery {
+
+// the most bytes a tile may decompress to (the default of gzip-hpp)
+static constexpr std::size_t max_decompressed_bytes = 1000000000;
+
+namespace {
+
+/// does the buffer start with the magic number of a zstd frame
+bool is_zstd(vtzero::data_view data) {
+    auto const* bytes = reinterpret_cast<unsigned char const*>(data.data()); // NOLINT
+    return data.size() > 4 && bytes[0] == 0x28 && bytes[1] == 0xB5 && bytes[2] == 0x2F && bytes[3] == 0xFD;
+}
+
+#ifdef VTQUERY_USE_LIBDEFLATE
+
+// deflate can't compress more than 1032:1
+constexpr std::size_t max_deflate_ratio = 1032;
+
+// gzip header (10 bytes) and footer (CRC32 and ISIZE, 4 bytes each)
+constexpr std::size_t min_gzip_size = 18;
+
+/// inflate a single gzip member with libdeflate, false if it has to be left to zlib
+bool inflate_gzip(libdeflate_decompressor* decompressor, std::string& output, vtzero::data_view compressed) {
+    auto const* bytes = reinterpret_cast<unsigned char const*>(compressed.data()); // NOLINT
+    std::size_t const size = compressed.size();
+    if (size < min_gzip_size || bytes[0] != 0x1F || bytes[1] != 0x8B) {
+        return false;
+    }
+    // ISIZE, the uncompressed size modulo 2^32 in little endian
+    std::size_t const uncompressed_size = static_cast<std::size_t>(bytes[size - 4]) |
+                                          static_cast<std::size_t>(bytes[size - 3]) << 8U |
+                                          static_cast<std::size_t>(bytes[size - 2]) << 16U |
+                                          static_cast<std::size_t>(bytes[size - 1]) << 24U;
+    if (uncompressed_size > max_decompressed_bytes || uncompressed_size > size * max_deflate_ratio) {
+        return false;
+    }
+    output.resize(uncompressed_size);
+    std::size_t in_size = 0;
+    std::size_t out_size = 0;
+    libdeflate_result const result = libdeflate_gzip_decompress_ex(decompressor, compressed.data(), size,
+                                                                   &output[0], uncompressed_size, &in_size, &out_size);
+    // anything else but a single member of exactly the stored size is left to zlib
+    return result == LIBDEFLATE_SUCCESS && in_size == size && out_size == uncompressed_size;
+}
+
+#endif
+
+#ifdef VTQUERY_USE_ZSTD
+
+// output size to start with if the frame doesn't tell its size
+constexpr std::size_t min_zstd_output = 64 * 1024;
+
+/// dictionaries added with add_zstd_dictionary, by their id
+class zstd_dictionaries {
+  public:
+    static zstd_dictionaries& shared() {
+        static zstd_dictionaries dictionaries;
+        return dictionaries;
+    }
+
+    void add(vtzero::data_view dictionary) {
+        unsigned const id = ZSTD_getDictID_fromDict(dictionary.data(), dictionary.size());
+        if (id == 0) {
+            throw std::invalid_argument("zstd dictionary has no dictionary id");
+        }
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = dictionaries_.find(id);
+        if (it != dictionaries_.end()) {
+            if (it->second.content != std::string(dictionary.data(), dictionary.size())) {
+                throw std::invalid_argument("a different zstd dictionary with id " + std::to_string(id) + " was already added");
+            }
+            return;
+        }
+        std::shared_ptr<ZSTD_DDict> ddict{ZSTD_createDDict(dictionary.data(), dictionary.size()), ZSTD_freeDDict};
+        if (!ddict) {
+            throw std::bad_alloc{}; // LCOV_EXCL_LINE
+        }
+        dictionaries_.emplace(id, entry{std::string(dictionary.data(), dictionary.size()), std::move(ddict)});
+    }
+
+    /// the dictionary with this id, nullptr if there is none
+    std::shared_ptr<ZSTD_DDict const> find(unsigned id) const {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto it = dictionaries_.find(id);
+        return it == dictionaries_.end() ? nullptr : it->second.ddict;
+    }
+
+  private:
+    struct entry {
+        std::string content;
+        std::shared_ptr<ZSTD_DDict> ddict;
+    };
+
+    mutable std::mutex mutex_;
+    std::map<unsigned, entry> dictionaries_;
+};
+
+/// decompress all zstd frames of the buffer, with the dictionary named by the first one
+void decompress_zstd(ZSTD_DCtx* context, std::string& output, vtzero::data_view compressed) {
+    ZSTD_DCtx_reset(context, ZSTD_reset_session_and_parameters);
+    // a dictionary added later can't be released while it is used
+    std::shared_ptr<ZSTD_DDict const> dictionary;
+    unsigned const dictionary_id = ZSTD_getDictID_fromFrame(compressed.data(), compressed.size());
+    if (dictionary_id != 0) {
+        dictionary = zstd_dictionaries::shared().find(dictionary_id);
+        if (!dictionary) {
+            throw std::runtime_error("zstd dictionary " + std::to_string(dictionary_id) + " of the tile was not added");
+        }
+        ZSTD_DCtx_refDDict(context, dictionary.get());
+    }
+
+    // the frame usually tells the size of its content, so the output has the right size from the start
+    unsigned long long const content_size = ZSTD_getFrameContentSize(compressed.data(), compressed.size());
+    if (content_size == ZSTD_CONTENTSIZE_ERROR) {
+        throw std::runtime_error("invalid zstd frame");
+    }
+    std::size_t capacity = std::max(compressed.size() * 4, min_zstd_output);
+    if (content_size != ZSTD_CONTENTSIZE_UNKNOWN && content_size <= max_decompressed_bytes) {
+        capacity = static_cast<std::size_t>(content_size);
+    }
+    output.resize(std::min(capacity, max_decompressed_bytes));
+
+    ZSTD_inBuffer in{compressed.data(), compressed.size(), 0};
+    ZSTD_outBuffer out{&output[0], output.size(), 0};
+    while (true) {
+        std::size_t const result = ZSTD_decompressStream(context, &out, &in);
+        if (ZSTD_isError(result) != 0U) {
+            throw std::runtime_error(ZSTD_getErrorName(result));
+        }
+        // the last frame is complete
+        if (result == 0 && in.pos == in.size) {
+            break;
+        }
+        if (out.pos == out.size) {
+            if (output.size() >= max_decompressed_bytes) {
+                throw std::runtime_error("size may use more memory than intended when decompressing");
+            }
+            output.resize(std::min(std::max(output.size() * 2, min_zstd_output), max_decompressed_bytes));
+            out.dst = &output[0];
+            out.size = output.size();
+        } else if (in.pos == in.size) {
+            throw std::runtime_error("truncated zstd frame");
+        }
+    }
+    output.resize(out.pos);
+}
+
+#endif
+
+} // namespace
+
+tile_decompressor::tile_decompressor()
+    : zlib_(max_decompressed_bytes) {
+#ifdef VTQUERY_USE_LIBDEFLATE
+    libdeflate_ = libdeflate_alloc_decompressor();
+    if (libdeflate_ == nullptr) {
+        throw std::bad_alloc{}; // LCOV_EXCL_LINE
+    }
+#endif
+#ifdef VTQUERY_USE_ZSTD
+    zstd_ = ZSTD_createDCtx();
+    if (zstd_ == nullptr) {
+        throw std::bad_alloc{}; // LCOV_EXCL_LINE
+    }
+#endif
+}
+
+tile_decompressor::~tile_decompressor() {
+#ifdef VTQUERY_USE_LIBDEFLATE
+    libdeflate_free_decompressor(libdeflate_);
+#endif
+#ifdef VTQUERY_USE_ZSTD
+    ZSTD_freeDCtx(zstd_);
+#endif
+}
+
+bool tile_decompressor::is_compressed(vtzero::data_view data) {
+    return gzip::is_compressed(data.data(), data.size()) || is_zstd(data);
+}
+
+void tile_decompressor::decompress(std::string& output, vtzero::data_view compressed) {
+    if (is_zstd(compressed)) {
+#ifdef VTQUERY_USE_ZSTD
+        decompress_zstd(zstd_, output, compressed);
+        return;
+#else
+        throw std::runtime_error("zstd compressed tiles need vtquery to be built with use_zstd=true");
+#endif
+    }
+#ifdef VTQUERY_USE_LIBDEFLATE
+    if (inflate_gzip(libdeflate_, output, compressed)) {
+        return;
+    }
+#endif
+    zlib_.decompress(output, compressed.data(), compressed.size());
+}
+
+tile_inflater::tile_inflater(vtzero::data_view compressed)
+    : stream_() {
+    // detect gzip or zlib from the header, like gzip-hpp
+    if (inflateInit2(&stream_, 32 + 15) != Z_OK) {
+        throw std::runtime_error("inflate init failed"); // LCOV_EXCL_LINE
+    }
+    stream_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data())); // NOLINT
+    stream_.avail_in = static_cast<unsigned int>(compressed.size());
+}
+
+tile_inflater::~tile_inflater() {
+    inflateEnd(&stream_);
+}
+
+std::size_t tile_inflater::inflate(char* output, std::size_t size) {
+    if (total_ + size > max_decompressed_bytes) {
+        if (!done_ && total_ >= max_decompressed_bytes) {
+            throw std::runtime_error("size may use more memory than intended when decompressing");
+        }
+        size = max_decompressed_bytes - total_;
+    }
+    stream_.next_out = reinterpret_cast<Bytef*>(output); // NOLINT
+    stream_.avail_out = static_cast<unsigned int>(size);
+    // inflate only stops short of filling the output at the end
+    while (!done_ && stream_.avail_out > 0) {
+        int const ret = ::inflate(&stream_, Z_NO_FLUSH);
+        if (ret != Z_STREAM_END && ret != Z_OK && ret != Z_BUF_ERROR) {
+            throw std::runtime_error(stream_.msg != nullptr ? stream_.msg : "inflate failed");
+        }
+        // the end of the stream, or of the input if it is cut off
+        done_ = ret == Z_STREAM_END || ret == Z_BUF_ERROR;
+    }
+    std::size_t const inflated = size - stream_.avail_out;
+    total_ += inflated;
+    return inflated;
+}
+
+void add_zstd_dictionary(vtzero::data_view dictionary) {
+#ifdef VTQUERY_USE_ZSTD
+    zstd_dictionaries::shared().add(dictionary);
+#else
+    static_cast<void>(dictionary);
+    throw std::runtime_error("zstd dictionaries need vtquery to be built with use_zstd=true");
+#endif
+}
+
+} // namespace VectorTileQuery
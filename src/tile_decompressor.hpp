@@ -0,0 +1,95 @@
+#pragma once
+#include <cstddef>
+#include <gzip/decompress.hpp>
+#include <string>
+#include <vtzero/types.hpp>
+#include <zlib.h>
+
+#ifdef VTQUERY_USE_LIBDEFLATE
+struct libdeflate_decompressor;
+#endif
+
+#ifdef VTQUERY_USE_ZSTD
+struct ZSTD_DCtx_s;
+#endif
+
+namespace VectorTileQuery {
+
+/*
+  Decompresses gzip, zlib and zstd tile buffers.
+
+  Built with `use_libdeflate=true` (see binding.gyp), a gzip buffer is inflated by libdeflate
+  in one go, into an output sized by the uncompressed size stored at the end of the buffer.
+  zlib is still used for zlib buffers (they don't store their size), for buffers whose stored
+  size can't be right or is over the limit, and for anything libdeflate doesn't decompress
+  completely (like several gzip members in a row or invalid data), so a tile decompresses to
+  the same bytes either way and invalid tiles fail with the errors of zlib.
+
+  zstd frames are decompressed when built with `use_zstd=true`, with the dictionary added by
+  add_zstd_dictionary() if the frame names one. Otherwise they fail with an error instead of
+  being read as an (invalid) uncompressed tile.
+
+  Keep one per thread and reuse it for all the tiles that thread decompresses.
+*/
+class tile_decompressor {
+  public:
+    tile_decompressor();
+    ~tile_decompressor();
+
+    // non-copyable
+    tile_decompressor(tile_decompressor const&) = delete;
+    tile_decompressor& operator=(tile_decompressor const&) = delete;
+
+    // non-movable
+    tile_decompressor(tile_decompressor&&) = delete;
+    tile_decompressor& operator=(tile_decompressor&&) = delete;
+
+    /// does the buffer start like a gzip, zlib or zstd stream
+    static bool is_compressed(vtzero::data_view data);
+
+    /// replace `output` with the decompressed `compressed`, throws if it is not valid
+    void decompress(std::string& output, vtzero::data_view compressed);
+
+  private:
+    gzip::Decompressor zlib_;
+#ifdef VTQUERY_USE_LIBDEFLATE
+    libdeflate_decompressor* libdeflate_;
+#endif
+#ifdef VTQUERY_USE_ZSTD
+    ZSTD_DCtx_s* zstd_;
+#endif
+};
+
+/*
+  Inflates a gzip or zlib buffer a step at a time, for readers that can use the start of the
+  output before the rest is inflated (or without inflating the rest at all). Like gzip-hpp it
+  only reads the first gzip member, ends early without an error if the input is cut off, and
+  fails with the errors of zlib.
+*/
+class tile_inflater {
+  public:
+    explicit tile_inflater(vtzero::data_view compressed);
+    ~tile_inflater();
+
+    // non-copyable
+    tile_inflater(tile_inflater const&) = delete;
+    tile_inflater& operator=(tile_inflater const&) = delete;
+
+    // non-movable
+    tile_inflater(tile_inflater&&) = delete;
+    tile_inflater& operator=(tile_inflater&&) = delete;
+
+    /// inflate up to `size` bytes to `output`, returns how many (0 only at the end)
+    std::size_t inflate(char* output, std::size_t size);
+
+  private:
+    z_stream stream_;
+    std::size_t total_ = 0;
+    bool done_ = false;
+};
+
+/// add a zstd dictionary for the frames that name its dictionary id, throws if it has no id or
+/// a different dictionary with the same id was added before
+void add_zstd_dictionary(vtzero::data_view dictionary);
+
+} // namespace VectorTileQuery
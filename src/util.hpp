@@ -1,6 +1,8 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <mapbox/cheap_ruler.hpp>
 #include <mapbox/geometry/algorithms/closest_point.hpp>
 #include <mapbox/geometry/geometry.hpp>
@@ -49,12 +51,12 @@ struct print_variant {
   Convert original lng/lat coordinates into a query point relative to the "active" tile in vector tile coordinates
   Returns a geometry.hpp point with std::int64_t values
 */
-mapbox::geometry::point<std::int64_t> create_query_point(double lng,
-                                                         double lat,
-                                                         std::uint32_t extent,
-                                                         std::int32_t active_tile_z,
-                                                         std::int32_t active_tile_x,
-                                                         std::int32_t active_tile_y) {
+inline mapbox::geometry::point<std::int64_t> create_query_point(double lng,
+                                                                double lat,
+                                                                std::uint32_t extent,
+                                                                std::int32_t active_tile_z,
+                                                                std::int32_t active_tile_x,
+                                                                std::int32_t active_tile_y) {
 
     lng = std::fmod((lng + 180.0), 360.0);
     if (lat > 89.9) {
@@ -81,11 +83,11 @@ mapbox::geometry::point<std::int64_t> create_query_point(double lng,
 /*
   Create a geometry.hpp point from vector tile coordinates
 */
-mapbox::geometry::point<double> convert_vt_to_ll(std::uint32_t extent,
-                                                 std::int32_t z,
-                                                 std::int32_t x,
-                                                 std::int32_t y,
-                                                 mapbox::geometry::algorithms::closest_point_info cp_info) {
+inline mapbox::geometry::point<double> convert_vt_to_ll(std::uint32_t extent,
+                                                        std::int32_t z,
+                                                        std::int32_t x,
+                                                        std::int32_t y,
+                                                        mapbox::geometry::algorithms::closest_point_info cp_info) {
     double z2 = static_cast<double>(static_cast<std::int64_t>(1) << z);
     double ex = static_cast<double>(extent);
     double size = ex * z2;
@@ -97,17 +99,150 @@ mapbox::geometry::point<double> convert_vt_to_ll(std::uint32_t extent,
     return mapbox::geometry::point<double>{x1, y1};
 }
 
+// Features may extend past their tile into its buffer, so tiles are only skipped when the
+// query point is out of the radius of the tile grown by this fraction of the tile size on
+// every side. It covers the common buffer sizes (up to 512 units with a 4096 extent).
+constexpr double tile_buffer_margin = 0.125;
+
+/// lng/lat bounds of a tile
+struct tile_bounds {
+    double west;
+    double south;
+    double east;
+    double north;
+};
+
+/*
+  Bounds of a tile, expanded by `buffer` (a fraction of the tile size) on every side.
+*/
+inline tile_bounds create_tile_bounds(std::int32_t z,
+                                      std::int32_t x,
+                                      std::int32_t y,
+                                      double buffer) {
+    double const z2 = static_cast<double>(static_cast<std::int64_t>(1) << z);
+    auto const tile_lng = [z2](double tx) {
+        return tx * 360.0 / z2 - 180.0;
+    };
+    auto const tile_lat = [z2](double ty) {
+        double const y2 = 180.0 - ty * 360.0 / z2;
+        return 360.0 / M_PI * std::atan(std::exp(y2 * M_PI / 180.0)) - 90.0;
+    };
+    return tile_bounds{tile_lng(x - buffer), tile_lat(y + 1 + buffer), tile_lng(x + 1 + buffer), tile_lat(y - buffer)};
+}
+
+/*
+  Lower bound of the distance (in meters) between the query point and anything within
+  the bounds of a tile.
+
+  Features can stick out of their tile into its buffer, so the bounds should be expanded
+  (see create_tile_bounds) before measuring. The ruler's distance is a weighted euclidean
+  distance in lng/lat, so the closest point of the bounds is the query point clamped to them.
+*/
+inline double tile_min_distance(mapbox::cheap_ruler::CheapRuler const& ruler,
+                                mapbox::geometry::point<double> const& lnglat,
+                                tile_bounds const& bounds) {
+    mapbox::geometry::point<double> const closest{std::min(std::max(lnglat.x, bounds.west), bounds.east),
+                                                  std::min(std::max(lnglat.y, bounds.south), bounds.north)};
+    return ruler.distance(lnglat, closest);
+}
+
 /*
   Get the distance (in meters) between two geometry.hpp points using cheap-ruler
   https://github.com/mapbox/cheap-ruler-cpp
 
-  The first point is considered the "origin" and its latitude is used to initialize
-  the ruler. The second is considered the "feature" and is the distance to.
+  The ruler is set up once per query with the latitude of the first point, which
+  is considered the "origin". The second is considered the "feature" and is the distance to.
 */
-double distance_in_meters(mapbox::geometry::point<double> const& origin_lnglat, mapbox::geometry::point<double> const& feature_lnglat) {
-    // set up cheap ruler with query latitude
-    mapbox::cheap_ruler::CheapRuler ruler(origin_lnglat.y, mapbox::cheap_ruler::CheapRuler::Meters);
-    auto d = ruler.distance(origin_lnglat, feature_lnglat);
-    return d;
+inline double distance_in_meters(mapbox::cheap_ruler::CheapRuler const& ruler,
+                                 mapbox::geometry::point<double> const& origin_lnglat,
+                                 mapbox::geometry::point<double> const& feature_lnglat) {
+    return ruler.distance(origin_lnglat, feature_lnglat);
 }
+
+/*
+  Approximate distances in meters, measured directly in the coordinates of one tile layer.
+
+  Longitude is linear in tile x, so the x axis uses cheap-ruler's exact factor. Latitude is
+  not linear in tile y, so the y axis uses the local Mercator scale at the query latitude
+  (d lat = cos(lat) * d y). The query point is kept at full precision rather than truncated
+  to tile coordinates like create_query_point does.
+
+  Compared to converting the closest point to lng/lat first, only the y axis is off: at a
+  distance d (meters) and latitude lat the error is at most about d * d * tan(|lat|) / R,
+  R being the earth's radius. That is 0.16m for 1km at 45 degrees, and nothing at the equator.
+*/
+class tile_distance {
+  public:
+    tile_distance(mapbox::cheap_ruler::CheapRuler const& ruler,
+                  double lng,
+                  double lat,
+                  double radius,
+                  std::uint32_t extent,
+                  std::int32_t z,
+                  std::int32_t x,
+                  std::int32_t y) {
+        // cheap-ruler's meters per degree of longitude and latitude at the query latitude
+        double const kx = ruler.distance({0.0, lat}, {1.0, lat});
+        double const ky = ruler.distance({0.0, lat}, {0.0, lat + 1.0});
+
+        double const size = static_cast<double>(extent) * static_cast<double>(static_cast<std::int64_t>(1) << z);
+        double const degrees_per_unit = 360.0 / size;
+        double const lat_radian = (std::min(std::max(lat, -89.9), 89.9) * M_PI) / 180.0;
+        query_x_ = (lng + 180.0) / degrees_per_unit - static_cast<double>(extent) * x;
+        query_y_ = (size / 2.0) * (1.0 - (std::log(std::tan(lat_radian) + 1.0 / std::cos(lat_radian)) / M_PI)) - static_cast<double>(extent) * y;
+
+        double const cos_lat = std::cos(lat * M_PI / 180.0);
+        double const sx = kx * degrees_per_unit;
+        double const sy = ky * cos_lat * degrees_per_unit;
+        sx2_ = sx * sx;
+        sy2_ = sy * sy;
+        min_scale_ = std::min(sx, sy);
+
+        // Anything within `radius` is within this many degrees of latitude, where cos(lat)
+        // is at least cos(max_lat). So the y axis overestimates by at most cos(lat) / cos(max_lat).
+        // Close to the poles (or off the Mercator map) there is no useful bound.
+        double const max_lat = std::abs(lat) + radius / ky;
+        if (max_lat < 85.0) {
+            max_overestimate_ = cos_lat / std::cos(max_lat * M_PI / 180.0);
+        }
+    }
+
+    /// squared approximate distance in meters between the query point and a point in tile coordinates
+    double squared_meters(double px, double py) const {
+        double const dx = px - query_x_;
+        double const dy = py - query_y_;
+        return dx * dx * sx2_ + dy * dy * sy2_;
+    }
+
+    /// true if a point at this squared approximate distance is certainly further than `meters`
+    /// (for any `meters` up to the radius this was set up with)
+    bool beyond(double squared_meters, double meters) const {
+        if (max_overestimate_ <= 0.0) {
+            return false;
+        }
+        // a little slack for floating point error
+        double const bound = meters * max_overestimate_ * (1.0 + 1e-9) + 1e-6;
+        return squared_meters > bound * bound;
+    }
+
+    /// distance in tile units from the truncated query point (see create_query_point) beyond which
+    /// a point is certainly further than `meters`, or infinity if there is no bound. With `approximate`
+    /// the squared_meters() themselves are what counts, rather than the distance after conversion.
+    double max_tile_distance(double meters, bool approximate) const {
+        double const overestimate = approximate ? 1.0 : max_overestimate_;
+        if (overestimate <= 0.0) {
+            return std::numeric_limits<double>::infinity();
+        }
+        // the truncated query point is up to sqrt(2) units off
+        return (meters * overestimate * (1.0 + 1e-9) + 1e-6) / min_scale_ + std::sqrt(2.0);
+    }
+
+  private:
+    double query_x_;
+    double query_y_;
+    double sx2_;
+    double sy2_;
+    double min_scale_;
+    double max_overestimate_ = 0.0; // 0.0 if there is no bound
+};
 } // namespace utils
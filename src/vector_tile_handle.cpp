@@ -0,0 +1,190 @@
+#include "vector_tile_handle.hpp"
+#include "tile_decompressor.hpp"
+
+#include <exception>
+#include <utility>
+
+namespace VectorTileQuery {
+
+Nan::Persistent<v8::FunctionTemplate> VectorTileHandle::constructor_template;
+Nan::Persistent<v8::Function> VectorTileHandle::constructor;
+
+std::shared_ptr<TileHandleData const> load_tile(std::int32_t z,
+                                                std::int32_t x,
+                                                std::int32_t y,
+                                                vtzero::data_view data,
+                                                bool index) {
+    auto tile_data = std::make_shared<TileHandleData>();
+    tile_data->z = z;
+    tile_data->x = x;
+    tile_data->y = y;
+    if (tile_decompressor::is_compressed(data)) {
+        tile_decompressor decompressor;
+        decompressor.decompress(tile_data->buffer, data);
+    } else {
+        tile_data->buffer.assign(data.data(), data.size());
+    }
+    vtzero::vector_tile tile{tile_data->buffer};
+    while (auto layer = tile.next_layer()) {
+        // read the tables now, so the layers are not changed by the queries reading them
+        layer.key_table();
+        layer.value_table();
+        tile_data->slabs.push_back(std::make_unique<lazy_polygon_slabs>(layer.num_features()));
+        tile_data->layers.push_back(std::move(layer));
+        if (index) {
+            tile_data->indexes.push_back(std::make_unique<lazy_feature_rtree>());
+        }
+    }
+    tile_data->bounds = utils::create_tile_bounds(z, x, y, utils::tile_buffer_margin);
+    return tile_data;
+}
+
+/// loads a tile on the threadpool and creates the VectorTileHandle for it
+struct LoadTileWorker : Nan::AsyncWorker {
+    using Base = Nan::AsyncWorker;
+
+    LoadTileWorker(std::int32_t z,
+                   std::int32_t x,
+                   std::int32_t y,
+                   bool index,
+                   v8::Local<v8::Object> buffer,
+                   Nan::Callback* cb)
+        : Base(cb, "vtquery:load_tile"),
+          z_(z),
+          x_(x),
+          y_(y),
+          index_(index),
+          data_(node::Buffer::Data(buffer), node::Buffer::Length(buffer)) {
+        // keep the buffer alive until the tile is loaded
+        SaveToPersistent("buffer", buffer);
+    }
+
+    void Execute() override {
+        try {
+            tile_data_ = load_tile(z_, x_, y_, data_, index_);
+        } catch (std::exception const& e) {
+            SetErrorMessage(e.what());
+        }
+    }
+
+    void HandleOKCallback() override {
+        Nan::HandleScope scope;
+        // the constructor only takes the loaded tile through an External
+        v8::Local<v8::Value> argv[1] = {Nan::New<v8::External>(&tile_data_)};
+        v8::Local<v8::Object> handle;
+        if (!Nan::NewInstance(Nan::New(VectorTileHandle::constructor), 1, static_cast<v8::Local<v8::Value>*>(argv)).ToLocal(&handle)) {
+            // LCOV_EXCL_START
+            v8::Local<v8::Value> error_argv[1] = {Nan::Error("unable to create VectorTileHandle")};
+            callback->Call(1, static_cast<v8::Local<v8::Value>*>(error_argv), async_resource);
+            return;
+            // LCOV_EXCL_STOP
+        }
+        v8::Local<v8::Value> result_argv[2] = {Nan::Null(), handle};
+        callback->Call(2, static_cast<v8::Local<v8::Value>*>(result_argv), async_resource);
+    }
+
+    std::int32_t z_;
+    std::int32_t x_;
+    std::int32_t y_;
+    bool index_;
+    vtzero::data_view data_;
+    std::shared_ptr<TileHandleData const> tile_data_;
+};
+
+VectorTileHandle::VectorTileHandle(std::shared_ptr<TileHandleData const> data)
+    : data_(std::move(data)) {}
+
+NAN_MODULE_INIT(VectorTileHandle::Init) {
+    v8::Local<v8::FunctionTemplate> tpl = Nan::New<v8::FunctionTemplate>(New);
+    tpl->SetClassName(Nan::New("VectorTileHandle").ToLocalChecked());
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    Nan::SetAccessor(tpl->InstanceTemplate(), Nan::New("z").ToLocalChecked(), GetZ);
+    Nan::SetAccessor(tpl->InstanceTemplate(), Nan::New("x").ToLocalChecked(), GetX);
+    Nan::SetAccessor(tpl->InstanceTemplate(), Nan::New("y").ToLocalChecked(), GetY);
+    Nan::SetMethod(tpl, "create", Create);
+
+    v8::Local<v8::Function> function = Nan::GetFunction(tpl).ToLocalChecked();
+    constructor_template.Reset(tpl);
+    constructor.Reset(function);
+    Nan::Set(target, Nan::New("VectorTileHandle").ToLocalChecked(), function);
+}
+
+bool VectorTileHandle::HasInstance(v8::Local<v8::Value> value) {
+    return Nan::New(constructor_template)->HasInstance(value);
+}
+
+NAN_METHOD(VectorTileHandle::New) {
+    if (!info.IsConstructCall() || info.Length() != 1 || !info[0]->IsExternal()) {
+        return Nan::ThrowTypeError("VectorTileHandle objects are created with VectorTileHandle.create()");
+    }
+    auto const* tile_data = static_cast<std::shared_ptr<TileHandleData const>*>(info[0].As<v8::External>()->Value());
+    auto* handle = new VectorTileHandle{*tile_data};
+    handle->Wrap(info.This());
+    info.GetReturnValue().Set(info.This());
+}
+
+NAN_METHOD(VectorTileHandle::Create) {
+    // validate callback function
+    v8::Local<v8::Value> callback_val = info[info.Length() - 1];
+    if (!callback_val->IsFunction()) {
+        Nan::ThrowError("last argument must be a callback function");
+        return;
+    }
+    v8::Local<v8::Function> callback = callback_val.As<v8::Function>();
+
+    if (info.Length() < 2 || !info[0]->IsObject()) {
+        return utils::CallbackError("first arg 'tile' must be an object with buffer, z, x and y values", callback);
+    }
+    v8::Local<v8::Object> tile_obj = info[0]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+    v8::Local<v8::Value> buf_val = Nan::Get(tile_obj, Nan::New("buffer").ToLocalChecked()).ToLocalChecked();
+    if (!node::Buffer::HasInstance(buf_val)) {
+        return utils::CallbackError("'buffer' value of the tile is not a true buffer", callback);
+    }
+    v8::Local<v8::Object> buffer = buf_val->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+    std::int32_t zxy[3];
+    char const* const names[3] = {"z", "x", "y"};
+    for (std::size_t i = 0; i < 3; ++i) {
+        v8::Local<v8::Value> val = Nan::Get(tile_obj, Nan::New(names[i]).ToLocalChecked()).ToLocalChecked();
+        if (!val->IsInt32() || Nan::To<std::int32_t>(val).FromJust() < 0) {
+            return utils::CallbackError(std::string("'") + names[i] + "' value of the tile must be an int32 not less than zero", callback);
+        }
+        zxy[i] = Nan::To<std::int32_t>(val).FromJust();
+    }
+
+    bool index = false;
+    if (info.Length() > 2) {
+        if (!info[1]->IsObject()) {
+            return utils::CallbackError("'options' arg must be an object", callback);
+        }
+        v8::Local<v8::Object> options = info[1]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+        if (Nan::Has(options, Nan::New("index").ToLocalChecked()).FromMaybe(false)) {
+            v8::Local<v8::Value> index_val = Nan::Get(options, Nan::New("index").ToLocalChecked()).ToLocalChecked();
+            if (!index_val->IsBoolean()) {
+                return utils::CallbackError("'index' must be a boolean", callback);
+            }
+            index = Nan::To<bool>(index_val).FromJust();
+        }
+    }
+
+    auto* worker = new LoadTileWorker{zxy[0], zxy[1], zxy[2], index, buffer, new Nan::Callback{callback}};
+    Nan::AsyncQueueWorker(worker);
+}
+
+NAN_GETTER(VectorTileHandle::GetZ) {
+    auto* handle = Nan::ObjectWrap::Unwrap<VectorTileHandle>(info.Holder());
+    info.GetReturnValue().Set(handle->data_->z);
+}
+
+NAN_GETTER(VectorTileHandle::GetX) {
+    auto* handle = Nan::ObjectWrap::Unwrap<VectorTileHandle>(info.Holder());
+    info.GetReturnValue().Set(handle->data_->x);
+}
+
+NAN_GETTER(VectorTileHandle::GetY) {
+    auto* handle = Nan::ObjectWrap::Unwrap<VectorTileHandle>(info.Holder());
+    info.GetReturnValue().Set(handle->data_->y);
+}
+
+} // namespace VectorTileQuery
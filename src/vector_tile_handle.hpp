@@ -0,0 +1,80 @@
+#pragma once
+#include "feature_rtree.hpp"
+#include "polygon_slabs.hpp"
+#include "util.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <nan.h>
+#include <string>
+#include <vector>
+#include <vtzero/vector_tile.hpp>
+
+namespace VectorTileQuery {
+
+/*
+  A tile that is decompressed and parsed once, to be queried many times.
+
+  It is never changed once it is loaded, so any number of queries (on any threads)
+  can read it at the same time. Queries hold on to it until they are done, even if
+  the VectorTileHandle it was loaded for is garbage collected in the meantime.
+*/
+struct TileHandleData {
+    std::int32_t z;
+    std::int32_t x;
+    std::int32_t y;
+    // the decompressed tile, the layers point into it
+    std::string buffer;
+    // the layers of the tile with their key and value tables already read, queries
+    // scan copies of them
+    std::vector<vtzero::layer> layers;
+    // bounds of the tile grown by utils::tile_buffer_margin, used to skip it
+    utils::tile_bounds bounds;
+    // spatial indexes of the layers (if the tile was loaded with `index: true`), each one is
+    // built by the first query that scans its layer
+    std::vector<std::unique_ptr<lazy_feature_rtree>> indexes;
+    // the edges of the large polygons of every layer bucketed into slabs, each one is built by the
+    // first point in polygon test of its polygon
+    std::vector<std::unique_ptr<lazy_polygon_slabs>> slabs;
+};
+
+/// decompress and parse a tile, vtzero throws if it is not a valid vector tile
+std::shared_ptr<TileHandleData const> load_tile(std::int32_t z,
+                                                std::int32_t x,
+                                                std::int32_t y,
+                                                vtzero::data_view data,
+                                                bool index);
+
+/*
+  JS object holding a loaded tile, created with `VectorTileHandle.create({buffer, z, x, y}, [options], callback)`
+  and passed to vtquery in place of the tile object.
+*/
+class VectorTileHandle : public Nan::ObjectWrap {
+  public:
+    static NAN_MODULE_INIT(Init);
+
+    /// is this a VectorTileHandle object
+    static bool HasInstance(v8::Local<v8::Value> value);
+
+    std::shared_ptr<TileHandleData const> const& data() const {
+        return data_;
+    }
+
+  private:
+    explicit VectorTileHandle(std::shared_ptr<TileHandleData const> data);
+
+    static NAN_METHOD(New);
+    static NAN_METHOD(Create);
+    static NAN_GETTER(GetZ);
+    static NAN_GETTER(GetX);
+    static NAN_GETTER(GetY);
+
+    static Nan::Persistent<v8::FunctionTemplate> constructor_template;
+    static Nan::Persistent<v8::Function> constructor;
+
+    std::shared_ptr<TileHandleData const> data_;
+
+    friend struct LoadTileWorker;
+};
+
+} // namespace VectorTileQuery
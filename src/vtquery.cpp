@@ -1,19 +1,27 @@
 #include "vtquery.hpp"
+#include "closest_point.hpp"
+#include "segment_kernels.hpp"
+#include "thread_pool.hpp"
+#include "tile_cache.hpp"
+#include "tile_decompressor.hpp"
 #include "util.hpp"
+#include "vector_tile_handle.hpp"
 
 #include <algorithm>
+#include <cmath>
 #include <exception>
-#include <gzip/decompress.hpp>
 #include <gzip/utils.hpp>
 #include <iostream>
+#include <iterator>
 #include <map>
 #include <mapbox/geometry/algorithms/closest_point.hpp>
-#include <mapbox/geometry/algorithms/closest_point_impl.hpp>
 #include <mapbox/geometry/geometry.hpp>
 #include <mapbox/vector_tile.hpp>
 #include <memory>
+#include <protozero/pbf_message.hpp>
 #include <queue>
 #include <stdexcept>
+#include <unordered_map>
 #include <utility>
 #include <vtzero/types.hpp>
 #include <vtzero/vector_tile.hpp>
@@ -30,11 +38,32 @@ const char* getGeomTypeString(int enumVal) {
     return GeomTypeStrings[enumVal]; // NOLINT to temporarily disable cppcoreguidelines-pro-bounds-constant-array-index, but this really should be fixed
 }
 
+// in parallel queries, layers with more encoded features than this are split into ranges of
+// features that are scanned concurrently, each range holding at least `min_chunk_bytes`
+static constexpr std::size_t split_layer_bytes = 256 * 1024;
+static constexpr std::size_t min_chunk_bytes = 64 * 1024;
+
+// in batches, the query points of a tile are scanned together in groups of at least this many
+// points (fewer if there aren't more), every group decodes the features of the tile once
+static constexpr std::size_t min_group_points = 64;
+// the query points of a group are bucketed by a grid of this many cells per side over the tile
+static constexpr std::int64_t point_grid_cells = 16;
+
+// in spatial joins, the points are bucketed by a grid with about this many points per cell, and
+// at most `max_join_grid_cells` cells per side. Polygons test the rows of cells they overlap in
+// bands of `join_band_rows` rows, every band is a task of the thread pool
+static constexpr std::size_t join_points_per_cell = 16;
+static constexpr std::int64_t max_join_grid_cells = 256;
+static constexpr std::int64_t join_band_rows = 16;
+
 using materialized_prop_type = std::pair<std::string, mapbox::feature::value>;
 
 /// main storage item for returning to the user
 struct ResultObject {
-    std::vector<vtzero::property> properties_vector;
+    // the layer and the feature the result was found in, its properties are only read from them
+    // once the results are final (or to compare it to a duplicate)
+    vtzero::data_view layer_data;
+    vtzero::data_view feature_data;
     std::vector<materialized_prop_type> properties_vector_materialized;
     std::string layer_name;
     mapbox::geometry::point<double> coordinates;
@@ -42,6 +71,17 @@ struct ResultObject {
     GeomType original_geometry_type{GeomType::unknown};
     bool has_id{false};
     uint64_t id{0};
+    // order in which the feature was found, used to break distance ties
+    std::uint64_t position{0};
+    // key of the result in the dedupe index
+    std::uint64_t dedupe_hash{0};
+    // with the tile_distance option, coordinates stay in the tile coordinates of this
+    // tile layer until the results are final, and are only converted to lng/lat then
+    bool tile_coordinates{false};
+    std::uint32_t extent{0};
+    std::int32_t tile_z{0};
+    std::int32_t tile_x{0};
+    std::int32_t tile_y{0};
 
     ResultObject() : coordinates(0.0, 0.0),
                      distance(std::numeric_limits<double>::max()) {}
@@ -53,6 +93,12 @@ struct ResultObject {
     ~ResultObject() = default;
 };
 
+/// counters reported with the `stats` option
+struct QueryStats {
+    std::uint32_t tiles{0};
+    std::uint32_t tiles_skipped{0};
+};
+
 /// an intermediate representation of a tile buffer and its necessary components
 struct TileObject {
     TileObject(std::int32_t z0,
@@ -62,10 +108,19 @@ struct TileObject {
         : z(z0),
           x(x0),
           y(y0),
-          data(node::Buffer::Data(buffer), node::Buffer::Length(buffer)) {
+          data(node::Buffer::Data(buffer), node::Buffer::Length(buffer)),
+          bounds(utils::create_tile_bounds(z0, x0, y0, utils::tile_buffer_margin)) {
         buffer_ref.Reset(buffer.As<v8::Object>());
     }
 
+    explicit TileObject(std::shared_ptr<TileHandleData const> handle0)
+        : z(handle0->z),
+          x(handle0->x),
+          y(handle0->y),
+          data(handle0->buffer),
+          bounds(handle0->bounds),
+          handle(std::move(handle0)) {}
+
     // explicitly use the destructor to clean up
     // the persistent buffer ref by Reset()-ing
     ~TileObject() {
@@ -87,11 +142,14 @@ struct TileObject {
     std::int32_t x;
     std::int32_t y;
     vtzero::data_view data;
+    // bounds of the tile grown by utils::tile_buffer_margin
+    utils::tile_bounds bounds;
     Nan::Persistent<v8::Object> buffer_ref;
+    // set for tiles passed as a VectorTileHandle, `data` is its decompressed tile then
+    std::shared_ptr<TileHandleData const> handle;
 };
 
 using value_type = boost::variant<float, double, int64_t, uint64_t, bool, std::string>;
-using map_type = std::unordered_map<std::string, value_type>;
 
 enum BasicFilterType {
     ne,
@@ -112,6 +170,13 @@ struct basic_filter_struct {
     value_type value;
 };
 
+/// which feature attributes have to match for two features to be duplicates
+enum DedupeKeyType {
+    dedupe_id,         // only ids, features without an id are never duplicates
+    dedupe_properties, // only properties, ids are ignored
+    dedupe_both        // properties, and ids when both features have one
+};
+
 enum BasicMetaFilterType {
     filter_all,
     filter_any
@@ -133,6 +198,12 @@ struct QueryData {
           num_results(5),
           dedupe(true),
           direct_hit_polygon(false),
+          dedupe_key(dedupe_both),
+          tile_distance(false),
+          stats(false),
+          parallel(false),
+          streaming(false),
+          select_properties(false),
           geometry_filter_type(GeomType::all) {
         tiles.reserve(num_tiles);
     }
@@ -156,6 +227,14 @@ struct QueryData {
     std::uint32_t num_results;
     bool dedupe;
     bool direct_hit_polygon;
+    DedupeKeyType dedupe_key;
+    bool tile_distance;
+    bool stats;
+    bool parallel;
+    bool streaming;
+    // with the `properties` option only the properties with these keys are read (none for `false`)
+    bool select_properties;
+    std::vector<std::string> properties;
     GeomType geometry_filter_type;
     meta_filter_struct basic_filter;
 };
@@ -214,39 +293,178 @@ GeomType get_geometry_type(vtzero::feature const& f) {
     return gt;
 }
 
+/// results are ordered by distance, ties are broken by the order the features were found in
 struct CompareDistance {
-    bool operator()(ResultObject const& r1, ResultObject const& r2) {
-        return r1.distance < r2.distance;
+    bool operator()(ResultObject const& r1, ResultObject const& r2) const {
+        if (r1.distance < r2.distance) {
+            return true;
+        }
+        if (r2.distance < r1.distance) {
+            return false;
+        }
+        return r1.position < r2.position;
+    }
+};
+
+/*
+  Bounded collection of the best results found so far.
+
+  Results live in stable slots and a max-heap of slot indexes (ordered by
+  CompareDistance) keeps the worst result on top, so deciding whether a candidate
+  makes the cut is O(1) and adding it is O(log K). Slots are only allocated as
+  results come in, and the final ordering is a single sort once the scan is done.
+*/
+class ResultQueue {
+  public:
+    explicit ResultQueue(std::size_t capacity)
+        : capacity_(capacity) {}
+
+    bool full() const {
+        return slots_.size() >= capacity_;
+    }
+
+    /// would a new result with this distance make it into the queue
+    bool accepts(double distance) const {
+        return !full() || distance < slots_[heap_.front()].distance;
+    }
+
+    std::size_t size() const {
+        return slots_.size();
+    }
+
+    /// slot of the result that is the next to be replaced
+    std::size_t worst() const {
+        return heap_.front();
+    }
+
+    ResultObject const& at(std::size_t slot) const {
+        return slots_[slot];
+    }
+
+    ResultObject& at(std::size_t slot) {
+        return slots_[slot];
+    }
+
+    /// add a result, replacing the worst one if the queue is full (check accepts() first)
+    std::size_t push(ResultObject&& result) {
+        std::size_t slot;
+        if (!full()) {
+            slot = slots_.size();
+            slots_.push_back(std::move(result));
+            heap_.push_back(slot);
+            heap_index_.push_back(heap_.size() - 1);
+            sift_up(heap_.size() - 1);
+        } else {
+            slot = heap_.front();
+            slots_[slot] = std::move(result);
+            sift_down(0);
+        }
+        return slot;
+    }
+
+    /// restore the heap order after the result in `slot` was replaced by a closer one
+    void improved(std::size_t slot) {
+        sift_down(heap_index_[slot]);
+    }
+
+    /// all results in their final order, this empties the queue
+    std::vector<ResultObject> release_sorted() {
+        std::sort(slots_.begin(), slots_.end(), CompareDistance());
+        heap_.clear();
+        heap_index_.clear();
+        return std::move(slots_);
+    }
+
+  private:
+    bool worse(std::size_t a, std::size_t b) const {
+        return CompareDistance()(slots_[heap_[b]], slots_[heap_[a]]);
+    }
+
+    void swap_nodes(std::size_t a, std::size_t b) {
+        std::swap(heap_[a], heap_[b]);
+        heap_index_[heap_[a]] = a;
+        heap_index_[heap_[b]] = b;
+    }
+
+    void sift_up(std::size_t i) {
+        while (i > 0) {
+            std::size_t const parent = (i - 1) / 2;
+            if (!worse(i, parent)) {
+                break;
+            }
+            swap_nodes(i, parent);
+            i = parent;
+        }
+    }
+
+    void sift_down(std::size_t i) {
+        std::size_t const n = heap_.size();
+        while (true) {
+            std::size_t const left = 2 * i + 1;
+            if (left >= n) {
+                break;
+            }
+            std::size_t child = left;
+            if (left + 1 < n && worse(left + 1, left)) {
+                child = left + 1;
+            }
+            if (!worse(child, i)) {
+                break;
+            }
+            swap_nodes(i, child);
+            i = child;
+        }
     }
+
+    std::size_t capacity_;
+    std::vector<ResultObject> slots_;
+    std::vector<std::size_t> heap_;       // max-heap of slot indexes
+    std::vector<std::size_t> heap_index_; // position of each slot in heap_
 };
 
-/// replace already existing results with a better, duplicate result
-void insert_result(ResultObject& old_result,
-                   std::vector<vtzero::property>& props_vec,
-                   std::string const& layer_name,
-                   mapbox::geometry::point<double> const& pt,
-                   double distance,
-                   GeomType geom_type,
-                   bool has_id,
-                   uint64_t id) {
+/*
+  The layers of results, parsed again from their data the first time the properties of a result
+  in them are read. Results only keep the data of their layer, the vtzero::layer they were found
+  with is gone by then.
+*/
+class LayerCache {
+  public:
+    vtzero::layer const& get(vtzero::data_view layer_data) {
+        for (auto const& layer : layers_) {
+            if (layer->data().data() == layer_data.data()) {
+                return *layer;
+            }
+        }
+        layers_.push_back(std::make_unique<vtzero::layer>(layer_data));
+        return *layers_.back();
+    }
+
+    /// drop the layer parsed from `layer_data`, before its memory is reused
+    void forget(vtzero::data_view layer_data) {
+        layers_.erase(std::remove_if(layers_.begin(), layers_.end(), [&layer_data](std::unique_ptr<vtzero::layer> const& layer) {
+                          return layer->data().data() == layer_data.data();
+                      }),
+                      layers_.end());
+    }
+
+  private:
+    std::vector<std::unique_ptr<vtzero::layer>> layers_;
+};
 
-    std::swap(old_result.properties_vector, props_vec);
-    old_result.layer_name = layer_name;
-    old_result.coordinates = pt;
-    old_result.distance = distance;
-    old_result.original_geometry_type = geom_type;
-    old_result.has_id = has_id;
-    old_result.id = id;
+/// the feature a result was found in, to read its properties
+vtzero::feature result_feature(ResultObject const& result, LayerCache& layers) {
+    return vtzero::feature{&layers.get(result.layer_data), result.feature_data};
 }
 
-/// generate a vector of vtzero::property objects
-std::vector<vtzero::property> get_properties_vector(vtzero::feature& feat) {
-    std::vector<vtzero::property> v;
-    v.reserve(feat.num_properties());
-    while (auto ii = feat.next_property()) {
-        v.push_back(ii);
+/// call `f(feature, feature_data)` for every feature of a layer in order, like vtzero::layer::next_feature() would
+template <typename F>
+void for_each_feature(vtzero::layer const& layer, F&& f) {
+    protozero::pbf_message<vtzero::detail::pbf_layer> reader{layer.data()};
+    while (reader.next(vtzero::detail::pbf_layer::features, protozero::pbf_wire_type::length_delimited)) {
+        vtzero::data_view const feature_data = reader.get_view();
+        vtzero::feature feature{&layer, feature_data};
+        f(feature, feature_data);
     }
-    return v;
 }
 
 double convert_to_double(value_type const& value) {
@@ -306,614 +524,2275 @@ bool single_filter_feature(basic_filter_struct const& filter, value_type const&
     return false;
 }
 
-/// apply filters to a feature - Returns true if feature matches all features
-bool filter_feature_all(vtzero::feature& feature, std::vector<basic_filter_struct> const& filters) {
-    auto features_property_map = vtzero::create_properties_map<map_type>(feature);
-    for (auto const& filter : filters) {
-        auto it = features_property_map.find(filter.key);
-        if (it != features_property_map.end()) {
-            value_type feature_value = it->second;
-            if (!single_filter_feature(filter, feature_value)) {
-                return false;
+/// basic-filters compiled once per query, filters are grouped by the property key they test
+struct FilterProgram {
+    explicit FilterProgram(meta_filter_struct const& meta_filter)
+        : type(meta_filter.type),
+          filters(meta_filter.filters) {
+        for (std::uint32_t i = 0; i < filters.size(); ++i) {
+            filters_by_key[filters[i].key].push_back(i);
+        }
+    }
+
+    BasicMetaFilterType type;
+    std::vector<basic_filter_struct> const& filters;
+    std::unordered_map<std::string, std::vector<std::uint32_t>> filters_by_key;
+};
+
+/*
+  A FilterProgram bound to the key and value tables of a layer.
+
+  Filters are resolved to key table indexes once per layer, and the result of a
+  filter on a value is cached by value table index, so a feature is evaluated by
+  walking its integer property tags without creating strings or property maps.
+  Like vtzero::create_properties_map, only the first value of a key counts, and
+  filters on keys that a feature does not have are ignored.
+*/
+class LayerFilter {
+  public:
+    LayerFilter(FilterProgram const& program, vtzero::layer const& layer)
+        : program_(program),
+          layer_(layer),
+          results_(program.filters.size()),
+          seen_(program.filters.size(), 0) {
+        if (program.filters.empty()) {
+            return;
+        }
+        auto const& keys = layer.key_table();
+        filters_by_key_.resize(keys.size(), nullptr);
+        for (std::size_t i = 0; i < keys.size(); ++i) {
+            auto it = program.filters_by_key.find(std::string(keys[i]));
+            if (it != program.filters_by_key.end()) {
+                filters_by_key_[i] = &it->second;
+                bound_ = true;
             }
         }
     }
-    return true;
-}
 
-/// apply filters to a feature - Returns true if feature matches any features
-bool filter_feature_any(vtzero::feature& feature, std::vector<basic_filter_struct> const& filters) {
-    auto features_property_map = vtzero::create_properties_map<map_type>(feature);
-    for (auto const& filter : filters) {
-        auto it = features_property_map.find(filter.key);
-        if (it != features_property_map.end()) {
-            value_type feature_value = it->second;
-            if (single_filter_feature(filter, feature_value)) {
+    /// Returns true if a feature matches the filters
+    bool matches(vtzero::feature const& feature) {
+        bool const match_all = program_.type == filter_all;
+        // none of the filter keys are in this layer
+        if (!bound_) {
+            return match_all;
+        }
+
+        ++generation_;
+        bool result = match_all;
+        feature.for_each_property_indexes([&](vtzero::index_value_pair const& tag) {
+            std::uint32_t const key = tag.key().value();
+            if (key >= filters_by_key_.size()) {
+                throw vtzero::out_of_range_exception{key};
+            }
+            auto const* filter_indexes = filters_by_key_[key];
+            if (filter_indexes == nullptr) {
                 return true;
             }
+            for (std::uint32_t const filter_index : *filter_indexes) {
+                if (seen_[filter_index] == generation_) {
+                    continue;
+                }
+                seen_[filter_index] = generation_;
+                // "all" is decided by the first filter that fails, "any" by the first that passes
+                if (evaluate(filter_index, tag.value().value()) != match_all) {
+                    result = !match_all;
+                    return false;
+                }
+            }
+            return true;
+        });
+        return result;
+    }
+
+  private:
+    bool evaluate(std::uint32_t filter_index, std::uint32_t value_index) {
+        auto const& values = layer_.value_table();
+        if (value_index >= values.size()) {
+            throw vtzero::out_of_range_exception{value_index};
+        }
+        auto& cache = results_[filter_index];
+        if (cache.empty()) {
+            cache.resize(values.size(), not_evaluated);
         }
+        if (cache[value_index] == not_evaluated) {
+            auto const value = vtzero::convert_property_value<value_type>(values[value_index]);
+            cache[value_index] = single_filter_feature(program_.filters[filter_index], value) ? passed : failed;
+        }
+        return cache[value_index] == passed;
     }
-    return false;
+
+    enum : std::int8_t {
+        not_evaluated = -1,
+        failed = 0,
+        passed = 1
+    };
+
+    FilterProgram const& program_;
+    vtzero::layer const& layer_;
+    // the filters testing each key table index, nullptr if none do
+    std::vector<std::vector<std::uint32_t> const*> filters_by_key_;
+    // result of each filter on each value table index, allocated on first use
+    std::vector<std::vector<std::int8_t>> results_;
+    // the feature each filter was last evaluated on
+    std::vector<std::uint64_t> seen_;
+    std::uint64_t generation_ = 0;
+    bool bound_ = false;
+};
+
+/// FNV-1a hash of a run of bytes
+std::uint64_t hash_bytes(std::uint64_t hash, vtzero::data_view const& bytes) {
+    char const* data = bytes.data();
+    for (std::size_t i = 0; i < bytes.size(); ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+std::uint64_t hash_combine(std::uint64_t hash, std::uint64_t value) {
+    return hash ^ (value + 0x9e3779b97f4a7c15ULL + (hash << 6U) + (hash >> 2U));
 }
 
-/// apply filters to a feature - Returns true if a feature matches the filters
-bool filter_feature(vtzero::feature& feature, std::vector<basic_filter_struct> const& filters, BasicMetaFilterType filter_type) {
-    if (filter_type == filter_all) {
-        return filter_feature_all(feature, filters);
+/// hash of the layer name, the base of the dedupe hash of every feature in that layer
+std::uint64_t layer_hash(vtzero::data_view const& layer_name) {
+    return hash_bytes(14695981039346656037ULL, layer_name);
+}
+
+/// hash everything that has to be equal for two features to be duplicates. Ids are
+/// left out unless they are the whole key, because a missing id matches any id.
+std::uint64_t dedupe_hash(std::uint64_t layer_hash,
+                          GeomType const geom,
+                          vtzero::feature const& feature,
+                          DedupeKeyType const dedupe_key) {
+    std::uint64_t hash = hash_combine(layer_hash, static_cast<std::uint64_t>(geom));
+    if (dedupe_key == dedupe_id) {
+        return hash_combine(hash, feature.id());
     }
-    return filter_feature_any(feature, filters);
+    // the properties are read straight from the tags, on a copy to leave the feature's iterator alone
+    vtzero::feature properties = feature;
+    while (auto prop = properties.next_property()) {
+        hash = hash_bytes(hash_combine(hash, prop.key().size()), prop.key());
+        hash = hash_bytes(hash_combine(hash, prop.value().data().size()), prop.value().data());
+    }
+    return hash;
 }
 
+/// results by dedupe hash, so only the results in the same bucket have to be compared
+class DedupeIndex {
+  public:
+    using index_type = std::unordered_multimap<std::uint64_t, std::size_t>;
+
+    std::pair<index_type::const_iterator, index_type::const_iterator> equal_range(std::uint64_t hash) const {
+        return index_.equal_range(hash);
+    }
+
+    void insert(std::uint64_t hash, std::size_t slot) {
+        index_.emplace(hash, slot);
+    }
+
+    void erase(std::uint64_t hash, std::size_t slot) {
+        auto range = index_.equal_range(hash);
+        for (auto it = range.first; it != range.second; ++it) {
+            if (it->second == slot) {
+                index_.erase(it);
+                return;
+            }
+        }
+    }
+
+  private:
+    index_type index_;
+};
+
 /// compare two features to determine if they are duplicates
 bool value_is_duplicate(ResultObject const& r,
-                        vtzero::feature const& candidate_feature,
-                        std::string const& candidate_layer,
-                        GeomType const candidate_geom,
-                        std::vector<vtzero::property> const& candidate_props_vec) {
+                        ResultObject const& candidate,
+                        DedupeKeyType const dedupe_key,
+                        LayerCache& layers) {
 
     // compare layer (if different layers, not duplicates)
-    if (r.layer_name != candidate_layer) {
+    if (r.layer_name != candidate.layer_name) {
         return false;
     }
 
     // compare geometry (if different geometry types, not duplicates)
-    if (r.original_geometry_type != candidate_geom) {
+    if (r.original_geometry_type != candidate.original_geometry_type) {
         return false;
     }
 
     // compare ids
-    if (r.has_id && candidate_feature.has_id() && r.id != candidate_feature.id()) {
+    if (dedupe_key == dedupe_id) {
+        return r.has_id && candidate.has_id && r.id == candidate.id;
+    }
+    if (dedupe_key == dedupe_both && r.has_id && candidate.has_id && r.id != candidate.id) {
         return false;
     }
 
-    // compare property tags
-    return r.properties_vector == candidate_props_vec;
+    // compare properties, one at a time
+    vtzero::feature r_feature = result_feature(r, layers);
+    vtzero::feature candidate_feature = result_feature(candidate, layers);
+    while (true) {
+        auto const r_property = r_feature.next_property();
+        auto const candidate_property = candidate_feature.next_property();
+        if (!r_property || !candidate_property) {
+            return !r_property && !candidate_property;
+        }
+        if (!(r_property == candidate_property)) {
+            return false;
+        }
+    }
 }
 
-/// main worker used by NAN
-struct Worker : Nan::AsyncWorker {
-    using Base = Nan::AsyncWorker;
+/// a copy of a candidate result (results are move-only so they are not copied by accident)
+ResultObject copy_result(ResultObject const& result) {
+    ResultObject copy;
+    copy.layer_data = result.layer_data;
+    copy.feature_data = result.feature_data;
+    copy.layer_name = result.layer_name;
+    copy.coordinates = result.coordinates;
+    copy.distance = result.distance;
+    copy.original_geometry_type = result.original_geometry_type;
+    copy.has_id = result.has_id;
+    copy.id = result.id;
+    copy.position = result.position;
+    copy.dedupe_hash = result.dedupe_hash;
+    copy.tile_coordinates = result.tile_coordinates;
+    copy.extent = result.extent;
+    copy.tile_z = result.tile_z;
+    copy.tile_x = result.tile_x;
+    copy.tile_y = result.tile_y;
+    return copy;
+}
 
-    /// set up major containers
-    std::unique_ptr<QueryData> query_data_;
-    std::vector<ResultObject> results_queue_;
+/// the best results of a query (or of one tile of a parallel query) with their dedupe index
+class ResultSet {
+  public:
+    explicit ResultSet(QueryData const& data)
+        : queue_(data.num_results),
+          radius_(data.radius),
+          dedupe_(data.dedupe),
+          dedupe_key_(data.dedupe_key) {}
+
+    /// once `limit` results are held, nothing further than the worst of them can make it in
+    double max_distance() const {
+        return queue_.full() ? std::min(radius_, queue_.at(queue_.worst()).distance) : radius_;
+    }
 
-    Worker(std::unique_ptr<QueryData> query_data,
-           Nan::Callback* cb)
-        : Base(cb, "vtquery:worker"),
-          query_data_(std::move(query_data)) {}
+    /// further than all current results, a candidate can neither be added nor replace a duplicate
+    bool rejects(double distance) const {
+        return queue_.full() && distance > queue_.at(queue_.worst()).distance;
+    }
 
-    void Execute() override {
-        try {
-            QueryData const& data = *query_data_;
+    /// is the candidate checked for duplicates (it needs a dedupe_hash then)
+    bool dedupes(ResultObject const& candidate) const {
+        return dedupe_ && (dedupe_key_ != dedupe_id || candidate.has_id);
+    }
 
-            std::vector<basic_filter_struct> filters = data.basic_filter.filters;
-            bool filter_enabled = !filters.empty();
-
-            // reserve the query results and fill with empty objects
-            results_queue_.reserve(data.num_results);
-            for (std::size_t i = 0; i < data.num_results; ++i) {
-                results_queue_.emplace_back();
-            }
-
-            // query point lng/lat geometry.hpp point (used for distance calculation later on)
-            mapbox::geometry::point<double> query_lnglat{data.longitude, data.latitude};
-
-            gzip::Decompressor decompressor;
-            std::string uncompressed;
-            std::vector<std::string> buffers;
-            std::vector<std::tuple<vtzero::vector_tile, std::int32_t, std::int32_t, std::int32_t>> tiles;
-            tiles.reserve(data.tiles.size());
-            for (auto const& tile_ptr : data.tiles) {
-                TileObject const& tile_obj = *tile_ptr;
-                if (gzip::is_compressed(tile_obj.data.data(), tile_obj.data.size())) {
-                    decompressor.decompress(uncompressed, tile_obj.data.data(), tile_obj.data.size());
-                    buffers.emplace_back(std::move(uncompressed));
-                    tiles.emplace_back(vtzero::vector_tile(buffers.back()), tile_obj.z, tile_obj.x, tile_obj.y);
-                } else {
-                    tiles.emplace_back(vtzero::vector_tile(tile_obj.data), tile_obj.z, tile_obj.x, tile_obj.y);
+    /// add a candidate that is not rejected, or let it replace a duplicate
+    void offer(ResultObject&& candidate) {
+        // check for duplicates
+        // if the candidate is a duplicate and smaller in distance, replace it
+        // if there are several, the closest one counts
+        bool const dedupe = dedupes(candidate);
+        if (dedupe) {
+            std::size_t duplicate = queue_.size();
+            auto const bucket = index_.equal_range(candidate.dedupe_hash);
+            for (auto it = bucket.first; it != bucket.second; ++it) {
+                std::size_t const slot = it->second;
+                if (value_is_duplicate(queue_.at(slot), candidate, dedupe_key_, layers_) &&
+                    (duplicate == queue_.size() || CompareDistance()(queue_.at(slot), queue_.at(duplicate)))) {
+                    duplicate = slot;
                 }
             }
-            // for each tile
-            for (auto& tile_obj : tiles) {
-                vtzero::vector_tile& tile = std::get<0>(tile_obj);
-                while (auto layer = tile.next_layer()) {
-
-                    // check if this is a layer we should query
-                    std::string layer_name = std::string(layer.name());
-                    if (!data.layers.empty() && std::find(data.layers.begin(), data.layers.end(), layer_name) == data.layers.end()) {
-                        continue;
+            if (duplicate != queue_.size()) {
+                ResultObject& result = queue_.at(duplicate);
+                // if we have a duplicate but it's lesser than what we already have, just skip and don't add below
+                if (candidate.distance <= result.distance) {
+                    // duplicates at the same distance keep the place of the one that comes first in the input and
+                    // the data of the one that comes last, whatever order the tiles are visited in
+                    bool const closer = candidate.distance < result.distance;
+                    if (closer || candidate.position > result.position) {
+                        std::uint64_t const position = closer ? candidate.position : result.position;
+                        result = std::move(candidate);
+                        result.position = position;
+                        ++accepted_;
+                    } else {
+                        result.position = candidate.position;
                     }
-
-                    std::uint32_t extent = layer.extent();
-                    std::int32_t tile_obj_z = std::get<1>(tile_obj);
-                    std::int32_t tile_obj_x = std::get<2>(tile_obj);
-                    std::int32_t tile_obj_y = std::get<3>(tile_obj);
-                    // query point in relation to the current tile the layer extent
-                    mapbox::geometry::point<std::int64_t> query_point = utils::create_query_point(data.longitude, data.latitude, extent, tile_obj_z, tile_obj_x, tile_obj_y);
-
-                    while (auto feature = layer.next_feature()) {
-                        auto original_geometry_type = get_geometry_type(feature);
-
-                        // check if this a geometry type we want to keep
-                        if (data.geometry_filter_type != GeomType::all && data.geometry_filter_type != original_geometry_type) {
-                            continue;
-                        }
-
-                        // implement closest point algorithm on query geometry and the query point
-                        auto const cp_info = mapbox::geometry::algorithms::closest_point(mapbox::vector_tile::extract_geometry<int64_t>(feature), query_point);
-
-                        // distance should never be less than zero, this is a safety check
-                        if (cp_info.distance < 0.0) {
-                            continue;
-                        }
-
-                        double meters = 0.0;
-                        auto ll = mapbox::geometry::point<double>{data.longitude, data.latitude}; // default to original query lng/lat
-
-                        // if distance from the query point is greater than 0.0 (not a direct hit) so recalculate the latlng
-                        if (cp_info.distance > 0.0) {
-                            ll = utils::convert_vt_to_ll(extent, tile_obj_z, tile_obj_x, tile_obj_y, cp_info);
-                            meters = utils::distance_in_meters(query_lnglat, ll);
-                        }
-
-                        // if distance from the query point is greater than the radius, don't add it
-                        if (meters > data.radius) {
-                            continue;
-                        }
-
-                        // If direct_hit_polygon is enabled, disallow polygons that do not contain the point
-                        if (meters > 0.0 && original_geometry_type == GeomType::polygon && data.direct_hit_polygon) {
-                            continue;
-                        }
-
-                        // If we have filters and the feature doesn't pass the filters, skip this feature
-                        if (filter_enabled && !filter_feature(feature, filters, data.basic_filter.type)) {
-                            continue;
-                        }
-
-                        // check for duplicates
-                        // if the candidate is a duplicate and smaller in distance, replace it
-                        bool found_duplicate = false;
-                        bool skip_duplicate = false;
-                        auto properties_vec = get_properties_vector(feature);
-                        if (data.dedupe) {
-                            for (auto& result : results_queue_) {
-                                if (value_is_duplicate(result, feature, layer_name, original_geometry_type, properties_vec)) {
-                                    if (meters <= result.distance) {
-                                        insert_result(result, properties_vec, layer_name, ll, meters, original_geometry_type, feature.has_id(), feature.id());
-                                        found_duplicate = true;
-                                        break;
-                                        // if we have a duplicate but it's lesser than what we already have, just skip and don't add below
-                                    }
-                                    skip_duplicate = true;
-                                    break;
-                                }
-                            }
-                        }
-
-                        if (skip_duplicate) {
-                            continue;
-                        }
-
-                        if (found_duplicate) {
-                            std::stable_sort(results_queue_.begin(), results_queue_.end(), CompareDistance());
-                            continue;
-                        }
-
-                        if (meters < results_queue_.back().distance) {
-                            insert_result(results_queue_.back(), properties_vec, layer_name, ll, meters, original_geometry_type, feature.has_id(), feature.id());
-                            std::stable_sort(results_queue_.begin(), results_queue_.end(), CompareDistance());
-                        }
-                    } // end tile.layer.feature loop
-                }     // end tile.layer loop
-            }         // end tile loop
-            // Here we create "materialized" properties. We do this here because, when reading from a compressed
-            // buffer, it is unsafe to touch `feature.properties_vector` once we've left this loop.
-            // That is because the buffer may represent uncompressed data that is not in scope outside of Execute()
-            for (auto& feature : results_queue_) {
-                feature.properties_vector_materialized.reserve(feature.properties_vector.size());
-                for (auto const& property : feature.properties_vector) {
-                    auto val = vtzero::convert_property_value<mapbox::feature::value, mapbox::vector_tile::detail::property_value_mapping>(property.value());
-                    feature.properties_vector_materialized.emplace_back(std::string(property.key()), std::move(val));
+                    queue_.improved(duplicate);
                 }
+                return;
             }
-        } catch (std::exception const& e) {
-            SetErrorMessage(e.what());
         }
-    }
-
-    void HandleOKCallback() override {
-        Nan::HandleScope scope;
-        try {
-            v8::Local<v8::Object> results_object = Nan::New<v8::Object>();
-            v8::Local<v8::Array> features_array = Nan::New<v8::Array>();
-            Nan::Set(results_object, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("FeatureCollection").ToLocalChecked());
-
-            // for each result object
-            while (!results_queue_.empty()) {
-                auto const& feature = results_queue_.back(); // get reference to top item in results queue
-                if (feature.distance < std::numeric_limits<double>::max()) {
-                    // if this is a default value, don't use it
-                    v8::Local<v8::Object> feature_obj = Nan::New<v8::Object>();
-                    Nan::Set(feature_obj, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("Feature").ToLocalChecked());
-                    Nan::Set(feature_obj, Nan::New("id").ToLocalChecked(), Nan::New<v8::Number>(feature.id));
-
-                    // create geometry object
-                    v8::Local<v8::Object> geometry_obj = Nan::New<v8::Object>();
-                    Nan::Set(geometry_obj, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("Point").ToLocalChecked());
-                    v8::Local<v8::Array> coordinates_array = Nan::New<v8::Array>(2);
-                    Nan::Set(coordinates_array, 0, Nan::New<v8::Number>(feature.coordinates.x)); // latitude
-                    Nan::Set(coordinates_array, 1, Nan::New<v8::Number>(feature.coordinates.y)); // longitude
-                    Nan::Set(geometry_obj, Nan::New("coordinates").ToLocalChecked(), coordinates_array);
-                    Nan::Set(feature_obj, Nan::New("geometry").ToLocalChecked(), geometry_obj);
-
-                    // create properties object
-                    v8::Local<v8::Object> properties_obj = Nan::New<v8::Object>();
-                    for (auto const& prop : feature.properties_vector_materialized) {
-                        set_property(prop, properties_obj);
-                    }
 
-                    // set properties.tilquery
-                    v8::Local<v8::Object> tilequery_properties_obj = Nan::New<v8::Object>();
-                    Nan::Set(tilequery_properties_obj, Nan::New("distance").ToLocalChecked(), Nan::New<v8::Number>(feature.distance));
-                    std::string og_geom = getGeomTypeString(feature.original_geometry_type);
-                    Nan::Set(tilequery_properties_obj, Nan::New("geometry").ToLocalChecked(), Nan::New<v8::String>(og_geom).ToLocalChecked());
-                    Nan::Set(tilequery_properties_obj, Nan::New("layer").ToLocalChecked(), Nan::New<v8::String>(feature.layer_name).ToLocalChecked());
-                    Nan::Set(properties_obj, Nan::New("tilequery").ToLocalChecked(), tilequery_properties_obj);
-
-                    // add properties to feature
-                    Nan::Set(feature_obj, Nan::New("properties").ToLocalChecked(), properties_obj);
-
-                    // add feature to features array
-                    Nan::Set(features_array, static_cast<uint32_t>(results_queue_.size() - 1), feature_obj);
-                }
-
-                results_queue_.pop_back();
+        if (queue_.accepts(candidate.distance)) {
+            if (queue_.full()) {
+                index_.erase(queue_.at(queue_.worst()).dedupe_hash, queue_.worst());
             }
+            std::uint64_t const hash = candidate.dedupe_hash;
+            std::size_t const slot = queue_.push(std::move(candidate));
+            if (dedupe) {
+                index_.insert(hash, slot);
+            }
+            ++accepted_;
+        }
+    }
 
-            Nan::Set(results_object, Nan::New("features").ToLocalChecked(), features_array);
-
-            auto const argc = 2u;
-            v8::Local<v8::Value> argv[argc] = {
-                Nan::Null(), results_object};
-
-            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+    /// number of candidates that were added or replaced a duplicate so far
+    std::size_t accepted() const {
+        return accepted_;
+    }
 
-        } catch (const std::exception& e) {
-            // unable to create test to throw exception here, the try/catch is simply
-            // for unexpected cases https://github.com/mapbox/vtquery/issues/69
-            // LCOV_EXCL_START
-            auto const argc = 1u;
-            v8::Local<v8::Value> argv[argc] = {Nan::Error(e.what())};
-            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
-            // LCOV_EXCL_STOP
+    /// the results found in the layer `layer_data` point into `copy` instead, a copy of the same bytes
+    void move_layer(vtzero::data_view layer_data, vtzero::data_view copy) {
+        layers_.forget(layer_data);
+        for (std::size_t slot = 0; slot < queue_.size(); ++slot) {
+            ResultObject& result = queue_.at(slot);
+            if (result.layer_data.data() == layer_data.data()) {
+                result.layer_data = copy;
+                result.feature_data = vtzero::data_view{copy.data() + (result.feature_data.data() - layer_data.data()), result.feature_data.size()};
+            }
         }
     }
-};
 
-NAN_METHOD(vtquery) {
-    // validate callback function
-    v8::Local<v8::Value> callback_val = info[info.Length() - 1];
-    if (!callback_val->IsFunction()) {
-        Nan::ThrowError("last argument must be a callback function");
-        return;
+    /// no result is in the layer `layer_data`, drop it before its memory is reused
+    void forget_layer(vtzero::data_view layer_data) {
+        layers_.forget(layer_data);
     }
-    v8::Local<v8::Function> callback = callback_val.As<v8::Function>();
 
-    // validate tiles
-    if (!info[0]->IsArray()) {
-        return utils::CallbackError("first arg 'tiles' must be an array of tile objects", callback);
+    /// all results in their final order, this empties the set
+    std::vector<ResultObject> release_sorted() {
+        return queue_.release_sorted();
     }
 
-    v8::Local<v8::Array> tiles_arr_val = info[0].As<v8::Array>();
-    unsigned num_tiles = tiles_arr_val->Length();
+  private:
+    ResultQueue queue_;
+    DedupeIndex index_;
+    // layers of the results, for comparing the properties of duplicates
+    LayerCache layers_;
+    double radius_;
+    bool dedupe_;
+    DedupeKeyType dedupe_key_;
+    std::size_t accepted_ = 0;
+};
 
-    if (num_tiles <= 0) {
-        return utils::CallbackError("'tiles' array must be of length greater than 0", callback);
-    }
+/// a little slack for floating point error in the tile bounds
+bool out_of_reach(double min_distance, double distance) {
+    return min_distance > distance * (1.0 + 1e-9) + 1e-6;
+}
 
-    std::unique_ptr<QueryData> query_data = std::make_unique<QueryData>(num_tiles);
+/// everything the scan of a tile needs that is the same for every tile of the query
+struct ScanContext {
+    QueryData const& data;
+    FilterProgram const& filter_program;
+    mapbox::cheap_ruler::CheapRuler const& ruler;
+    // query point lng/lat geometry.hpp point (used for distance calculation later on)
+    mapbox::geometry::point<double> query_lnglat;
+    // with tile_distance, result distances are not comparable to the tile bounds
+    bool shrink_radius;
+    // with a radius of 0 only features that contain or touch the query point make it into the results
+    bool direct_hits_only;
+};
 
-    for (unsigned t = 0; t < num_tiles; ++t) {
-        v8::Local<v8::Value> tile_val = Nan::Get(tiles_arr_val, t).ToLocalChecked();
-        if (!tile_val->IsObject()) {
-            return utils::CallbackError("items in 'tiles' array must be objects", callback);
-        }
-        v8::Local<v8::Object> tile_obj = tile_val->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+/// is this a layer we should query
+bool layer_selected(QueryData const& data, vtzero::layer const& layer) {
+    return data.layers.empty() || std::find(data.layers.begin(), data.layers.end(), std::string(layer.name())) != data.layers.end();
+}
 
-        // check buffer value
-        if (!Nan::Has(tile_obj, Nan::New("buffer").ToLocalChecked()).FromMaybe(false)) {
-            return utils::CallbackError("item in 'tiles' array does not include a buffer value", callback);
-        }
-        v8::Local<v8::Value> buf_val = Nan::Get(tile_obj, Nan::New("buffer").ToLocalChecked()).ToLocalChecked();
-        if (buf_val->IsNull() || buf_val->IsUndefined()) {
-            return utils::CallbackError("buffer value in 'tiles' array item is null or undefined", callback);
-        }
-        v8::Local<v8::Object> buffer = buf_val->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
-        if (!node::Buffer::HasInstance(buffer)) {
-            return utils::CallbackError("buffer value in 'tiles' array item is not a true buffer", callback);
-        }
+/// does a feature have the geometry type and pass the filters we query for
+bool feature_selected(QueryData const& data, LayerFilter& layer_filter, vtzero::feature const& feature, GeomType geometry_type) {
+    // check if this a geometry type we want to keep
+    if (data.geometry_filter_type != GeomType::all && data.geometry_filter_type != geometry_type) {
+        return false;
+    }
+    // If we have filters and the feature doesn't pass the filters, skip this feature
+    // (before decoding its geometry, filters only look at properties)
+    return data.basic_filter.filters.empty() || layer_filter.matches(feature);
+}
 
-        // z value
-        if (!Nan::Has(tile_obj, Nan::New("z").ToLocalChecked()).FromMaybe(false)) {
-            return utils::CallbackError("item in 'tiles' array does not include a 'z' value", callback);
-        }
-        v8::Local<v8::Value> z_val = Nan::Get(tile_obj, Nan::New("z").ToLocalChecked()).ToLocalChecked();
-        if (!z_val->IsInt32()) {
-            return utils::CallbackError("'z' value in 'tiles' array item is not an int32", callback);
-        }
-        std::int32_t z = Nan::To<std::int32_t>(z_val).FromJust();
-        if (z < 0) {
-            return utils::CallbackError("'z' value must not be less than zero", callback);
-        }
+/// the polygon slabs of a layer of a loaded tile, nullptr for tiles that are read from their buffer
+lazy_polygon_slabs const* layer_slabs(TileObject const& tile_obj, std::uint64_t layer_index) {
+    if (!tile_obj.handle || layer_index >= tile_obj.handle->slabs.size()) {
+        return nullptr;
+    }
+    return tile_obj.handle->slabs[layer_index].get();
+}
 
-        // x value
-        if (!Nan::Has(tile_obj, Nan::New("x").ToLocalChecked()).FromMaybe(false)) {
-            return utils::CallbackError("item in 'tiles' array does not include a 'x' value", callback);
-        }
-        v8::Local<v8::Value> x_val = Nan::Get(tile_obj, Nan::New("x").ToLocalChecked()).ToLocalChecked();
-        if (!x_val->IsInt32()) {
-            return utils::CallbackError("'x' value in 'tiles' array item is not an int32", callback);
-        }
-        std::int32_t x = Nan::To<std::int32_t>(x_val).FromJust();
-        if (x < 0) {
-            return utils::CallbackError("'x' value must not be less than zero", callback);
+/*
+  Offers the features of a layer that are within reach to the results. Features are
+  ordered by their place in the input (`position`), whatever order the tiles are visited in.
+
+  If `candidates` is given, a copy of every candidate that is offered is kept there, in the
+  order they are offered, so they can be offered to another ResultSet later on.
+
+  The filter is bound to the layer by the caller, so the scans of several query points over
+  the same layer can share it (it is not thread-safe though).
+*/
+class LayerScan {
+  public:
+    LayerScan(ScanContext const& ctx,
+              std::size_t tile_index,
+              vtzero::layer const& layer,
+              std::uint64_t layer_index,
+              LayerFilter& layer_filter)
+        : ctx_(ctx),
+          tile_z_(ctx.data.tiles[tile_index]->z),
+          tile_x_(ctx.data.tiles[tile_index]->x),
+          tile_y_(ctx.data.tiles[tile_index]->y),
+          layer_position_((static_cast<std::uint64_t>(tile_index) << 48U) | (layer_index << 32U)),
+          layer_name_(layer.name()),
+          layer_name_hash_(layer_hash(layer.name())),
+          extent_(layer.extent()),
+          // query point in relation to the current tile the layer extent
+          query_point_(utils::create_query_point(ctx.query_lnglat.x, ctx.query_lnglat.y, extent_, tile_z_, tile_x_, tile_y_)),
+          layer_filter_(layer_filter),
+          layer_distance_(ctx.ruler, ctx.query_lnglat.x, ctx.query_lnglat.y, ctx.data.radius, extent_, tile_z_, tile_x_, tile_y_),
+          radius_(ctx.data.radius),
+          direct_hits_only_(ctx.direct_hits_only),
+          direct_hit_polygon_(ctx.data.direct_hit_polygon),
+          tile_distance_(ctx.data.tile_distance),
+          slabs_(layer_slabs(*ctx.data.tiles[tile_index], layer_index)),
+          layer_data_(layer.data()) {}
+
+    /// `feature_data` is the encoded feature (see for_each_feature), results keep it to read its properties later on
+    void scan(vtzero::feature const& feature,
+              vtzero::data_view feature_data,
+              std::uint64_t feature_index,
+              ResultSet& results,
+              std::vector<ResultObject>* candidates) {
+        auto original_geometry_type = get_geometry_type(feature);
+        if (!feature_selected(ctx_.data, layer_filter_, feature, original_geometry_type)) {
+            return;
         }
+        measure(feature, feature_data, feature, original_geometry_type, feature_index, results, candidates);
+    }
 
-        // y value
-        if (!Nan::Has(tile_obj, Nan::New("y").ToLocalChecked()).FromMaybe(false)) {
-            return utils::CallbackError("item in 'tiles' array does not include a 'y' value", callback);
-        }
-        v8::Local<v8::Value> y_val = Nan::Get(tile_obj, Nan::New("y").ToLocalChecked()).ToLocalChecked();
-        if (!y_val->IsInt32()) {
-            return utils::CallbackError("'y' value in 'tiles' array item is not an int32", callback);
+    /// like scan(), for a feature that was already selected (see feature_selected) and whose
+    /// geometry was decoded before
+    void scan(vtzero::feature const& feature,
+              vtzero::data_view feature_data,
+              GeomType original_geometry_type,
+              decoded_geometry const& geometry,
+              std::uint64_t feature_index,
+              ResultSet& results,
+              std::vector<ResultObject>* candidates) {
+        // nothing within its bounding box can make it into the results
+        double const max_tile_distance = reach(results);
+        if (geometry.squared_distance(query_point_) > max_tile_distance * max_tile_distance) {
+            return;
         }
-        std::int32_t y = Nan::To<std::int32_t>(y_val).FromJust();
-        if (y < 0) {
-            return utils::CallbackError("'y' value must not be less than zero", callback);
-        }
-
-        // in-place construction
-        std::unique_ptr<TileObject> tile{new TileObject{z, x, y, buffer}};
-        query_data->tiles.push_back(std::move(tile));
+        measure(feature, feature_data, geometry, original_geometry_type, feature_index, results, candidates);
     }
 
-    // validate lng/lat array
-    if (!info[1]->IsArray()) {
-        return utils::CallbackError("second arg 'lnglat' must be an array with [longitude, latitude] values", callback);
+    /// distance in tile units beyond which no feature can make it into `results`
+    double reach(ResultSet const& results) const {
+        return layer_distance_.max_tile_distance(results.max_distance(), tile_distance_);
     }
 
-    // v8::Local<v8::Array> lnglat_val(info[1]);
-    v8::Local<v8::Array> lnglat_val = info[1].As<v8::Array>();
-    if (lnglat_val->Length() != 2) {
-        return utils::CallbackError("'lnglat' must be an array of [longitude, latitude]", callback);
+    /// the query point in the tile coordinates of this layer
+    mapbox::geometry::point<std::int64_t> const& query_point() const {
+        return query_point_;
     }
 
-    v8::Local<v8::Value> lng_val = Nan::Get(lnglat_val, 0).ToLocalChecked();
-    v8::Local<v8::Value> lat_val = Nan::Get(lnglat_val, 1).ToLocalChecked();
-    if (!lng_val->IsNumber() || !lat_val->IsNumber()) {
-        return utils::CallbackError("lnglat values must be numbers", callback);
+    /// scan the features whose bounding box is within reach, in the order of the layer
+    /// (`layer` is the layer the tree was built for, or a copy of it)
+    void scan(feature_rtree const& tree,
+              vtzero::layer const& layer,
+              ResultSet& results,
+              std::vector<ResultObject>* candidates) {
+        std::vector<feature_rtree::hit> hits;
+        tree.search(static_cast<double>(query_point_.x), static_cast<double>(query_point_.y), reach(results), hits);
+        std::sort(hits.begin(), hits.end(), [](feature_rtree::hit const& a, feature_rtree::hit const& b) {
+            return a.feature < b.feature;
+        });
+        for (auto const& hit : hits) {
+            // the results may have filled up since
+            double const max_tile_distance = reach(results);
+            if (hit.squared_distance > max_tile_distance * max_tile_distance) {
+                continue;
+            }
+            vtzero::feature feature{&layer, tree.feature(hit.feature)};
+            scan(feature, tree.feature(hit.feature), hit.feature, results, candidates);
+        }
     }
-    query_data->longitude = Nan::To<double>(lng_val).FromJust();
-    query_data->latitude = Nan::To<double>(lat_val).FromJust();
-
-    // validate options object if it exists
-    // defaults are set in the QueryData struct.
-    if (info.Length() > 3) {
 
-        if (!info[2]->IsObject()) {
-            return utils::CallbackError("'options' arg must be an object", callback);
+    /*
+      Like scanning every feature of the layer, for queries of point features only. The points of
+      the selected features are decoded into contiguous arrays and measured in a single sweep, then
+      the `limit` closest features are measured and offered first, so the results fill up and the
+      rest of the features are only offered if they are still within reach. Properties are only
+      read for the features that make it into the results (see measure()).
+    */
+    void scan_points(vtzero::layer const& layer,
+                     ResultSet& results,
+                     std::vector<ResultObject>* candidates) {
+        point_collector collector;
+        std::vector<vtzero::feature> features;
+        std::vector<vtzero::data_view> features_data;
+        std::vector<std::uint64_t> feature_indexes;
+        // the points of feature f end at collector.xs[ends[f]]
+        std::vector<std::size_t> ends;
+        std::uint64_t feature_index = 0;
+        for_each_feature(layer, [&](vtzero::feature const& feature, vtzero::data_view feature_data) {
+            std::uint64_t const index = feature_index++;
+            if (feature.geometry_type() != vtzero::GeomType::POINT || !feature_selected(ctx_.data, layer_filter_, feature, GeomType::point)) {
+                return;
+            }
+            vtzero::decode_point_geometry(feature.geometry(), collector);
+            features.push_back(feature);
+            features_data.push_back(feature_data);
+            feature_indexes.push_back(index);
+            ends.push_back(collector.xs.size());
+        });
+
+        // squared distances in tile units, the loop is simple enough to be vectorized
+        std::size_t const num_points = collector.xs.size();
+        std::vector<double> squared_distances(num_points);
+        double const qx = static_cast<double>(query_point_.x);
+        double const qy = static_cast<double>(query_point_.y);
+        std::int32_t const* xs = collector.xs.data();
+        std::int32_t const* ys = collector.ys.data();
+        double* out = squared_distances.data();
+        for (std::size_t i = 0; i < num_points; ++i) {
+            double const dx = static_cast<double>(xs[i]) - qx;
+            double const dy = static_cast<double>(ys[i]) - qy;
+            out[i] = dx * dx + dy * dy;
         }
 
-        v8::Local<v8::Object> options = info[2]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
-
-        if (Nan::Has(options, Nan::New("dedupe").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> dedupe_val = Nan::Get(options, Nan::New("dedupe").ToLocalChecked()).ToLocalChecked();
-            if (!dedupe_val->IsBoolean()) {
-                return utils::CallbackError("'dedupe' must be a boolean", callback);
+        // the closest point of every feature that is within reach
+        double const max_tile_distance = reach(results);
+        std::vector<std::pair<double, std::size_t>> order;
+        std::size_t begin = 0;
+        for (std::size_t f = 0; f < features.size(); ++f) {
+            if (ends[f] > begin) {
+                double const squared_distance = *std::min_element(squared_distances.begin() + static_cast<std::ptrdiff_t>(begin),
+                                                                  squared_distances.begin() + static_cast<std::ptrdiff_t>(ends[f]));
+                if (squared_distance <= max_tile_distance * max_tile_distance) {
+                    order.emplace_back(squared_distance, f);
+                }
             }
-
-            bool dedupe = Nan::To<bool>(dedupe_val).FromJust();
-            query_data->dedupe = dedupe;
+            begin = ends[f];
         }
 
-        if (Nan::Has(options, Nan::New("direct_hit_polygon").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> direct_hit_polygon_val = Nan::Get(options, Nan::New("direct_hit_polygon").ToLocalChecked()).ToLocalChecked();
-            if (!direct_hit_polygon_val->IsBoolean()) {
-                return utils::CallbackError("'direct_hit_polygon' must be a boolean", callback);
+        auto const closest = order.begin() + static_cast<std::ptrdiff_t>(std::min<std::size_t>(order.size(), ctx_.data.num_results));
+        std::nth_element(order.begin(), closest, order.end());
+        std::sort(order.begin(), closest);
+        for (auto const& entry : order) {
+            // the results may have filled up since
+            double const tile_distance = reach(results);
+            if (entry.first > tile_distance * tile_distance) {
+                continue;
             }
-
-            bool direct_hit_polygon = Nan::To<bool>(direct_hit_polygon_val).FromJust();
-            query_data->direct_hit_polygon = direct_hit_polygon;
+            std::size_t const f = entry.second;
+            measure(features[f], features_data[f], features[f], GeomType::point, feature_indexes[f], results, candidates);
         }
+    }
 
-        if (Nan::Has(options, Nan::New("radius").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> radius_val = Nan::Get(options, Nan::New("radius").ToLocalChecked()).ToLocalChecked();
-            if (!radius_val->IsNumber()) {
-                return utils::CallbackError("'radius' must be a number", callback);
-            }
+  private:
+    /// vtzero point geometry handler collecting the coordinates of the points of many features
+    struct point_collector {
+        std::vector<std::int32_t> xs;
+        std::vector<std::int32_t> ys;
 
-            double radius = Nan::To<double>(radius_val).FromJust();
-            if (radius < 0.0) {
-                return utils::CallbackError("'radius' must be a positive number", callback);
-            }
+        void points_begin(std::uint32_t /*count*/) {}
 
-            query_data->radius = radius;
+        void points_point(vtzero::point const& pt) {
+            xs.push_back(pt.x);
+            ys.push_back(pt.y);
         }
 
-        if (Nan::Has(options, Nan::New("limit").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> num_results_val = Nan::Get(options, Nan::New("limit").ToLocalChecked()).ToLocalChecked();
-            if (!num_results_val->IsNumber()) {
-                return utils::CallbackError("'limit' must be a number", callback);
-            }
-
-            std::int32_t num_results = Nan::To<std::int32_t>(num_results_val).FromJust();
-            if (num_results < 1) {
-                return utils::CallbackError("'limit' must be 1 or greater", callback);
+        void points_end() {}
+    };
+
+    /// measure a selected feature (its geometry is the feature or a decoded_geometry of it) and
+    /// offer it to the results if it is within reach
+    template <typename Geometry>
+    void measure(vtzero::feature const& feature,
+                 vtzero::data_view feature_data,
+                 Geometry const& geometry,
+                 GeomType original_geometry_type,
+                 std::uint64_t feature_index,
+                 ResultSet& results,
+                 std::vector<ResultObject>* candidates) {
+        std::uint64_t const feature_position = layer_position_ | feature_index;
+
+        // stream the geometry through the closest point algorithm, without materializing it,
+        // and skip the parts of it that are too far away to make it into the results
+        // (only direct hits can be kept with a radius of 0 or polygons with direct_hit_polygon, those
+        // run a containment test and only measure what is within the truncation error of the query point)
+        mapbox::geometry::algorithms::closest_point_info cp_info;
+        // (large polygons of tile handles only test the edges near the query point, see polygon_slabs)
+        if (direct_hits_only_ || (direct_hit_polygon_ && original_geometry_type == GeomType::polygon)) {
+            double const near_distance = layer_distance_.max_tile_distance(0.0, tile_distance_);
+            polygon_slabs const* slabs = nullptr;
+            if (slabs_ != nullptr && original_geometry_type == GeomType::polygon) {
+                slabs = slabs_->get(feature_index, feature);
             }
-            if (num_results > 1000) {
-                return utils::CallbackError("'limit' must be less than 1000", callback);
+            if (slabs != nullptr) {
+                cp_info = slabs_direct_hit(*slabs, query_point_, near_distance);
+            } else {
+                cp_info = feature_direct_hit(geometry, query_point_, near_distance);
             }
+        } else {
+            cp_info = feature_closest_point(geometry, query_point_, reach(results));
+        }
 
-            query_data->num_results = static_cast<std::uint32_t>(num_results);
+        // distance should never be less than zero, this is a safety check
+        if (cp_info.distance < 0.0) {
+            return;
         }
 
-        if (Nan::Has(options, Nan::New("layers").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> layers_val = Nan::Get(options, Nan::New("layers").ToLocalChecked()).ToLocalChecked();
-            if (!layers_val->IsArray()) {
-                return utils::CallbackError("'layers' must be an array of strings", callback);
+        double meters = 0.0;
+        auto ll = ctx_.query_lnglat; // default to original query lng/lat
+
+        // if distance from the query point is greater than 0.0 (not a direct hit) so recalculate the latlng
+        bool tile_coordinates = false;
+        if (cp_info.distance > 0.0) {
+            double const squared_meters = layer_distance_.squared_meters(cp_info.x, cp_info.y);
+            if (tile_distance_) {
+                // rank by the tile space distance, only the final results are converted
+                meters = std::sqrt(squared_meters);
+                ll = mapbox::geometry::point<double>{cp_info.x, cp_info.y};
+                tile_coordinates = true;
+            } else {
+                // skip the lng/lat conversion for features that are certainly out of the radius, or
+                // further than all current results (those could neither be added nor replace a duplicate)
+                if (layer_distance_.beyond(squared_meters, results.max_distance())) {
+                    return;
+                }
+                ll = utils::convert_vt_to_ll(extent_, tile_z_, tile_x_, tile_y_, cp_info);
+                meters = utils::distance_in_meters(ctx_.ruler, ctx_.query_lnglat, ll);
             }
+        }
 
-            v8::Local<v8::Array> layers_arr = layers_val.As<v8::Array>();
-            unsigned num_layers = layers_arr->Length();
+        // if distance from the query point is greater than the radius, don't add it
+        if (meters > radius_) {
+            return;
+        }
 
-            // only gather layers if there are some in the array
-            if (num_layers > 0) {
-                for (unsigned j = 0; j < num_layers; ++j) {
-                    v8::Local<v8::Value> layer_val = Nan::Get(layers_arr, j).ToLocalChecked();
-                    if (!layer_val->IsString()) {
-                        return utils::CallbackError("'layers' values must be strings", callback);
-                    }
+        // further than all current results, it can neither be added nor replace a duplicate
+        if (results.rejects(meters)) {
+            return;
+        }
 
-                    Nan::Utf8String layer_utf8_value(layer_val);
-                    int layer_str_len = layer_utf8_value.length();
-                    if (layer_str_len <= 0) {
-                        return utils::CallbackError("'layers' values must be non-empty strings", callback);
-                    }
+        // If direct_hit_polygon is enabled, disallow polygons that do not contain the point
+        if (meters > 0.0 && original_geometry_type == GeomType::polygon && direct_hit_polygon_) {
+            return;
+        }
 
-                    query_data->layers.emplace_back(*layer_utf8_value, static_cast<std::size_t>(layer_str_len));
-                }
-            }
+        ResultObject candidate;
+        candidate.layer_data = layer_data_;
+        candidate.feature_data = feature_data;
+        candidate.layer_name = layer_name_;
+        candidate.coordinates = ll;
+        candidate.distance = meters;
+        candidate.original_geometry_type = original_geometry_type;
+        candidate.has_id = feature.has_id();
+        candidate.id = feature.id();
+        candidate.position = feature_position;
+        candidate.tile_coordinates = tile_coordinates;
+        candidate.extent = extent_;
+        candidate.tile_z = tile_z_;
+        candidate.tile_x = tile_x_;
+        candidate.tile_y = tile_y_;
+        if (results.dedupes(candidate)) {
+            candidate.dedupe_hash = dedupe_hash(layer_name_hash_, original_geometry_type, feature, ctx_.data.dedupe_key);
+        }
+        if (candidates != nullptr) {
+            candidates->push_back(copy_result(candidate));
         }
+        results.offer(std::move(candidate));
+    }
 
-        if (Nan::Has(options, Nan::New("geometry").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> geometry_val = Nan::Get(options, Nan::New("geometry").ToLocalChecked()).ToLocalChecked();
-            if (!geometry_val->IsString()) {
-                return utils::CallbackError("'geometry' option must be a string", callback);
-            }
+    ScanContext const& ctx_;
+    std::int32_t tile_z_;
+    std::int32_t tile_x_;
+    std::int32_t tile_y_;
+    std::uint64_t layer_position_;
+    std::string layer_name_;
+    std::uint64_t layer_name_hash_;
+    std::uint32_t extent_;
+    mapbox::geometry::point<std::int64_t> query_point_;
+    LayerFilter& layer_filter_;
+    utils::tile_distance layer_distance_;
+    double radius_;
+    bool direct_hits_only_;
+    bool direct_hit_polygon_;
+    bool tile_distance_;
+    lazy_polygon_slabs const* slabs_;
+    vtzero::data_view layer_data_;
+};
 
-            Nan::Utf8String geometry_utf8_value(geometry_val);
-            std::int32_t geometry_str_len = geometry_utf8_value.length();
-            if (geometry_str_len <= 0) {
-                return utils::CallbackError("'geometry' value must be a non-empty string", callback);
-            }
+/// a range of the features of a layer, scanned on its own in parallel queries
+struct LayerChunk {
+    std::size_t tile_index;
+    // a copy for every chunk, a layer reads its key and value tables lazily
+    vtzero::layer layer;
+    std::uint64_t layer_index;
+    std::shared_ptr<std::vector<vtzero::data_view> const> features;
+    std::size_t begin;
+    std::size_t end;
+    std::vector<ResultObject> candidates;
+};
 
-            std::string geometry(*geometry_utf8_value, static_cast<std::size_t>(geometry_str_len));
-            if (geometry == "point") {
-                query_data->geometry_filter_type = GeomType::point;
-            } else if (geometry == "linestring") {
-                query_data->geometry_filter_type = GeomType::linestring;
-            } else if (geometry == "polygon") {
-                query_data->geometry_filter_type = GeomType::polygon;
-            } else {
-                return utils::CallbackError("'geometry' must be 'point', 'linestring', or 'polygon'", callback);
+/// split a layer into ranges of features with about the same amount of encoded data, up to `max_chunks`.
+/// Returns false without adding any if the layer has at most `split_layer_bytes` of encoded features.
+bool split_layer(std::size_t tile_index,
+                 vtzero::layer const& layer,
+                 std::uint64_t layer_index,
+                 std::size_t max_chunks,
+                 std::vector<LayerChunk>& chunks) {
+    auto features = std::make_shared<std::vector<vtzero::data_view>>();
+    features->reserve(layer.num_features());
+    std::size_t total_bytes = 0;
+    protozero::pbf_message<vtzero::detail::pbf_layer> reader{layer.data()};
+    while (reader.next(vtzero::detail::pbf_layer::features, protozero::pbf_wire_type::length_delimited)) {
+        features->push_back(reader.get_view());
+        total_bytes += features->back().size();
+    }
+    // the key and value tables don't count, they are not scanned
+    if (total_bytes <= split_layer_bytes) {
+        return false;
+    }
+    std::size_t const num_chunks = std::max<std::size_t>(1, std::min(max_chunks, total_bytes / min_chunk_bytes));
+    std::size_t begin = 0;
+    std::size_t bytes = 0;
+    for (std::size_t chunk = 1; chunk <= num_chunks; ++chunk) {
+        std::size_t end = begin;
+        if (chunk == num_chunks) {
+            end = features->size();
+        } else {
+            while (end < features->size() && bytes < total_bytes / num_chunks * chunk) {
+                bytes += (*features)[end++].size();
             }
         }
+        if (end > begin) {
+            chunks.push_back(LayerChunk{tile_index, layer, layer_index, features, begin, end, {}});
+        }
+        begin = end;
+    }
+    return true;
+}
 
-        if (Nan::Has(options, Nan::New("basic-filters").ToLocalChecked()).FromMaybe(false)) {
-            v8::Local<v8::Value> basic_filter_val = Nan::Get(options, Nan::New("basic-filters").ToLocalChecked()).ToLocalChecked();
-            if (!basic_filter_val->IsArray()) {
-                return utils::CallbackError("'basic-filters' must be of the form [type, [filters]]", callback);
-            }
-
-            v8::Local<v8::Array> basic_filter_array = basic_filter_val.As<v8::Array>();
-            unsigned basic_filter_length = basic_filter_array->Length();
+/// the layer after `layer_index` - 1, tiles loaded as a VectorTileHandle copy their parsed layers
+vtzero::layer next_layer(TileObject const& tile_obj, vtzero::vector_tile& tile, std::uint64_t layer_index) {
+    if (tile_obj.handle) {
+        auto const& layers = tile_obj.handle->layers;
+        return layer_index < layers.size() ? layers[layer_index] : vtzero::layer{};
+    }
+    return tile.next_layer();
+}
 
-            // gather filters from an array
-            if (basic_filter_length == 2) {
-                v8::Local<v8::Value> basic_filter_type = Nan::Get(basic_filter_array, 0).ToLocalChecked();
-                if (!basic_filter_type->IsString()) {
-                    return utils::CallbackError("'basic-filters' must be of the form [string, [filters]]", callback);
-                }
-                Nan::Utf8String basic_filter_type_utf8_value(basic_filter_type);
-                std::int32_t basic_filter_type_str_len = basic_filter_type_utf8_value.length();
-                std::string basic_filter_type_str(*basic_filter_type_utf8_value, static_cast<std::size_t>(basic_filter_type_str_len));
-                if (basic_filter_type_str == "all") {
-                    query_data->basic_filter.type = filter_all;
-                } else if (basic_filter_type_str == "any") {
-                    query_data->basic_filter.type = filter_any;
+/*
+  Offer every feature of a tile that is within reach to the results (see LayerScan). The layers
+  of tiles loaded with an index only visit the features whose bounding box is within reach.
+
+  If `chunks` is given, layers with more than `split_layer_bytes` of encoded features are
+  split into up to `max_chunks` ranges that are added there instead of being scanned.
+*/
+void scan_tile(ScanContext const& ctx,
+               std::size_t tile_index,
+               double tile_min_distance,
+               vtzero::data_view tile_data,
+               ResultSet& results,
+               std::vector<ResultObject>* candidates,
+               std::vector<LayerChunk>* chunks = nullptr,
+               std::size_t max_chunks = 1) {
+    TileObject const& tile_obj = *ctx.data.tiles[tile_index];
+    vtzero::vector_tile tile{tile_data};
+    std::uint64_t layer_index = 0;
+    while (auto layer = next_layer(tile_obj, tile, layer_index)) {
+        // the remaining layers of this tile are all out of reach as well
+        if (ctx.shrink_radius && out_of_reach(tile_min_distance, results.max_distance())) {
+            break;
+        }
+        if (layer_selected(ctx.data, layer)) {
+            if (tile_obj.handle && !tile_obj.handle->indexes.empty()) {
+                // only visit the features near the query point
+                feature_rtree const& tree = tile_obj.handle->indexes[layer_index]->get(tile_obj.handle->layers[layer_index]);
+                LayerFilter layer_filter{ctx.filter_program, layer};
+                LayerScan layer_scan{ctx, tile_index, layer, layer_index, layer_filter};
+                layer_scan.scan(tree, layer, results, candidates);
+            } else if (chunks != nullptr && max_chunks > 1 && layer.data().size() > split_layer_bytes &&
+                       split_layer(tile_index, layer, layer_index, max_chunks, *chunks)) {
+                // the ranges are scanned once every tile is
+            } else if (ctx.data.geometry_filter_type == GeomType::point && !ctx.direct_hits_only) {
+                LayerFilter layer_filter{ctx.filter_program, layer};
+                LayerScan layer_scan{ctx, tile_index, layer, layer_index, layer_filter};
+                layer_scan.scan_points(layer, results, candidates);
+            } else {
+                LayerFilter layer_filter{ctx.filter_program, layer};
+                LayerScan layer_scan{ctx, tile_index, layer, layer_index, layer_filter};
+                std::uint64_t feature_index = 0;
+                for_each_feature(layer, [&](vtzero::feature const& feature, vtzero::data_view feature_data) {
+                    layer_scan.scan(feature, feature_data, feature_index++, results, candidates);
+                });
+            }
+        }
+        ++layer_index;
+    }
+}
+
+/*
+  A gzip or zlib tile that is inflated while it is read: the fields of the tile are handed out
+  one at a time, as soon as all of their bytes are inflated. Only the field being read is kept
+  in memory, the next one replaces it.
+*/
+class StreamedTile {
+  public:
+    explicit StreamedTile(vtzero::data_view compressed)
+        : inflater_(compressed) {}
+
+    /// the next field of the tile (valid until the next call), empty at the end of the tile. If the
+    /// tile ends in the middle of a field or the field is not valid, this is the rest of the tile.
+    vtzero::data_view next_field() {
+        begin_ = field_end_;
+        std::size_t size = 0;
+        std::uint64_t key = 0;
+        if (!read_varint(size, key)) {
+            return rest();
+        }
+        switch (key & 0x07U) {
+        case 0: { // varint
+            std::uint64_t value = 0;
+            if (!read_varint(size, value)) {
+                return rest();
+            }
+            break;
+        }
+        case 1: // fixed64
+            size += 8;
+            break;
+        case 2: { // length delimited
+            std::uint64_t length = 0;
+            if (!read_varint(size, length)) {
+                return rest();
+            }
+            // protozero reads lengths as 32 bit
+            size += static_cast<std::uint32_t>(length);
+            break;
+        }
+        case 5: // fixed32
+            size += 4;
+            break;
+        default:
+            return rest();
+        }
+        if (!fill(size)) {
+            return rest();
+        }
+        field_end_ = begin_ + size;
+        return vtzero::data_view{&window_[begin_], size};
+    }
+
+  private:
+    static constexpr std::size_t inflate_step = 64 * 1024;
+
+    /// read the varint at `offset` from the start of the field and move `offset` past it
+    bool read_varint(std::size_t& offset, std::uint64_t& value) {
+        value = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (!fill(offset + 1)) {
+                return false;
+            }
+            auto const byte = static_cast<unsigned char>(window_[begin_ + offset++]);
+            value |= static_cast<std::uint64_t>(byte & 0x7FU) << shift;
+            if ((byte & 0x80U) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// make sure the first `size` bytes of the field are inflated, false if the tile ends before
+    bool fill(std::size_t size) {
+        while (end_ - begin_ < size) {
+            if (begin_ > 0) {
+                // the earlier fields are done with
+                std::copy(window_.begin() + static_cast<std::ptrdiff_t>(begin_), window_.begin() + static_cast<std::ptrdiff_t>(end_), window_.begin());
+                end_ -= begin_;
+                field_end_ -= begin_;
+                begin_ = 0;
+            }
+            window_.resize(std::max(window_.size(), end_ + inflate_step));
+            std::size_t const inflated = inflater_.inflate(&window_[end_], window_.size() - end_);
+            if (inflated == 0) {
+                return false;
+            }
+            end_ += inflated;
+        }
+        return true;
+    }
+
+    /// everything that is left of the tile
+    vtzero::data_view rest() {
+        while (fill(end_ - begin_ + 1)) {
+        }
+        field_end_ = end_;
+        return vtzero::data_view{&window_[begin_], end_ - begin_};
+    }
+
+    tile_inflater inflater_;
+    // inflated bytes, from the start of the current field
+    std::string window_;
+    std::size_t begin_ = 0;
+    std::size_t field_end_ = 0;
+    std::size_t end_ = 0;
+};
+
+/*
+  Like scan_tile, for a gzip or zlib tile that is inflated while it is scanned: every layer is
+  scanned as soon as it is inflated, and once the rest of the tile is out of reach it isn't
+  inflated at all. Layers are scanned where they were inflated, and only the ones that results
+  were found in are copied to `buffers` for the results to point into.
+*/
+void scan_streamed_tile(ScanContext const& ctx,
+                        std::size_t tile_index,
+                        double tile_min_distance,
+                        vtzero::data_view compressed,
+                        ResultSet& results,
+                        std::vector<std::shared_ptr<std::string const>>& buffers) {
+    StreamedTile tile{compressed};
+    std::uint64_t layer_index = 0;
+    while (true) {
+        // the remaining layers of this tile are all out of reach as well
+        if (ctx.shrink_radius && out_of_reach(tile_min_distance, results.max_distance())) {
+            break;
+        }
+        vtzero::data_view const field = tile.next_field();
+        if (field.empty()) {
+            break;
+        }
+        // read the field like vtzero::vector_tile::next_layer() would, with the same errors
+        protozero::pbf_message<vtzero::detail::pbf_tile> reader{field};
+        if (!reader.next(vtzero::detail::pbf_tile::layers, protozero::pbf_wire_type::length_delimited)) {
+            continue;
+        }
+        vtzero::layer layer{reader.get_view()};
+        if (layer_selected(ctx.data, layer)) {
+            std::size_t const accepted = results.accepted();
+            LayerFilter layer_filter{ctx.filter_program, layer};
+            LayerScan layer_scan{ctx, tile_index, layer, layer_index, layer_filter};
+            std::uint64_t feature_index = 0;
+            for_each_feature(layer, [&](vtzero::feature const& feature, vtzero::data_view feature_data) {
+                layer_scan.scan(feature, feature_data, feature_index++, results, nullptr);
+            });
+            // the next field replaces the layer in the window of the stream
+            if (results.accepted() != accepted) {
+                auto layer_data = std::make_shared<std::string>(layer.data().data(), layer.data().size());
+                buffers.push_back(layer_data);
+                results.move_layer(layer.data(), vtzero::data_view{*layer_data});
+            } else {
+                results.forget_layer(layer.data());
+            }
+        }
+        ++layer_index;
+    }
+}
+
+/// decompressed copy of a compressed tile, taken from the tile cache if it is enabled
+std::shared_ptr<std::string const> decompress_tile(vtzero::data_view compressed, tile_decompressor& decompressor) {
+    tile_cache& cache = tile_cache::shared();
+    bool const cached = cache.enabled();
+    if (cached) {
+        if (auto decompressed = cache.find(compressed)) {
+            return decompressed;
+        }
+    }
+    auto decompressed = std::make_shared<std::string>();
+    decompressor.decompress(*decompressed, compressed);
+    if (cached) {
+        cache.insert(compressed, decompressed);
+    }
+    return decompressed;
+}
+
+/// skip tiles that are entirely out of the radius, and visit the others closest first so the results
+/// fill up with close features early and the remaining tiles can be skipped: pairs of the minimum
+/// distance and index of the tiles to visit, in order
+std::vector<std::pair<double, std::size_t>> order_tiles(ScanContext const& ctx, QueryStats& stats) {
+    QueryData const& data = ctx.data;
+    std::vector<std::pair<double, std::size_t>> tile_order;
+    tile_order.reserve(data.tiles.size());
+    for (std::size_t tile_index = 0; tile_index < data.tiles.size(); ++tile_index) {
+        TileObject const& tile_obj = *data.tiles[tile_index];
+        ++stats.tiles;
+        double const min_distance = utils::tile_min_distance(ctx.ruler, ctx.query_lnglat, tile_obj.bounds);
+        if (out_of_reach(min_distance, data.radius)) {
+            ++stats.tiles_skipped;
+            continue;
+        }
+        tile_order.emplace_back(min_distance, tile_index);
+    }
+    std::stable_sort(tile_order.begin(), tile_order.end(), [](std::pair<double, std::size_t> const& a, std::pair<double, std::size_t> const& b) {
+        return a.first < b.first;
+    });
+    return tile_order;
+}
+
+/*
+  Offer the candidates that every tile offered to its own results (in the order of `tile_order`) to
+  the query's results, in the serial visiting order, so the results are the same as scanning the
+  tiles one after the other. The tiles and layers the serial scan skips are skipped, they are only
+  out of reach if none of their features stick out of their tile further than the margin.
+*/
+void offer_candidates(ScanContext const& ctx,
+                      std::vector<std::pair<double, std::size_t>> const& tile_order,
+                      std::vector<std::vector<ResultObject>>& candidates,
+                      ResultSet& results,
+                      QueryStats& stats) {
+    for (std::size_t i = 0; i < tile_order.size(); ++i) {
+        double const tile_min_distance = tile_order[i].first;
+        if (ctx.shrink_radius && out_of_reach(tile_min_distance, results.max_distance())) {
+            ++stats.tiles_skipped;
+            continue;
+        }
+        std::uint64_t layer_position = std::numeric_limits<std::uint64_t>::max();
+        for (auto& candidate : candidates[i]) {
+            if (candidate.position >> 32U != layer_position) {
+                if (ctx.shrink_radius && out_of_reach(tile_min_distance, results.max_distance())) {
+                    break;
+                }
+                layer_position = candidate.position >> 32U;
+            }
+            if (!results.rejects(candidate.distance)) {
+                results.offer(std::move(candidate));
+            }
+        }
+    }
+}
+
+/// is this one of the keys of the `properties` option
+bool property_selected(QueryData const& data, vtzero::data_view key) {
+    return std::any_of(data.properties.begin(), data.properties.end(), [&key](std::string const& selected) {
+        return selected.size() == key.size() && std::equal(selected.begin(), selected.end(), key.data());
+    });
+}
+
+/// read the properties of a result out of its tile, into properties_vector_materialized (only the
+/// selected ones with the `properties` option, the values of the others are not even decoded)
+void materialize_properties(ResultObject& feature, LayerCache& layers, QueryData const& data) {
+    if (data.select_properties && data.properties.empty()) {
+        return;
+    }
+    vtzero::feature tile_feature = result_feature(feature, layers);
+    feature.properties_vector_materialized.reserve(data.select_properties ? data.properties.size() : tile_feature.num_properties());
+    while (auto property = tile_feature.next_property()) {
+        if (data.select_properties && !property_selected(data, property.key())) {
+            continue;
+        }
+        auto val = vtzero::convert_property_value<mapbox::feature::value, mapbox::vector_tile::detail::property_value_mapping>(property.value());
+        feature.properties_vector_materialized.emplace_back(std::string(property.key()), std::move(val));
+    }
+}
+
+/*
+  The results in their final order and with their properties materialized, so they no longer
+  point into the tiles. This empties `results`.
+*/
+std::vector<ResultObject> finish_results(ScanContext const& ctx, ResultSet& results) {
+    std::vector<ResultObject> final_results = results.release_sorted();
+    if (ctx.data.tile_distance) {
+        // convert the final results to lng/lat and exact distances, and drop the ones
+        // that turn out to be out of the radius after all
+        for (auto& result : final_results) {
+            if (result.tile_coordinates) {
+                mapbox::geometry::algorithms::closest_point_info const cp_info{result.coordinates.x, result.coordinates.y, 0.0};
+                result.coordinates = utils::convert_vt_to_ll(result.extent, result.tile_z, result.tile_x, result.tile_y, cp_info);
+                result.distance = utils::distance_in_meters(ctx.ruler, ctx.query_lnglat, result.coordinates);
+            }
+        }
+        final_results.erase(std::remove_if(final_results.begin(), final_results.end(), [&ctx](ResultObject const& result) {
+                                 return result.distance > ctx.data.radius;
+                             }),
+                             final_results.end());
+        std::sort(final_results.begin(), final_results.end(), CompareDistance());
+    }
+    // Here we create "materialized" properties, the properties of the results were not read until now.
+    // It is unsafe to touch the tile data of the results once we've left this loop, because the buffer
+    // may represent uncompressed data that is not in scope outside of this function
+    LayerCache layers;
+    for (auto& feature : final_results) {
+        materialize_properties(feature, layers, ctx.data);
+    }
+    return final_results;
+}
+
+/*
+  The results of a query around `query_lnglat`, in their final order and with their properties
+  materialized, so they no longer point into the tiles. Tiles are skipped and visited closest
+  first, one after the other or on the thread pool with the `parallel` option.
+*/
+std::vector<ResultObject> query_point(QueryData const& data,
+                                      mapbox::geometry::point<double> const& query_lnglat,
+                                      QueryStats& stats) {
+    FilterProgram const filter_program{data.basic_filter};
+    mapbox::cheap_ruler::CheapRuler const ruler(query_lnglat.y, mapbox::cheap_ruler::CheapRuler::Meters);
+    ScanContext const ctx{data, filter_program, ruler, query_lnglat, !data.tile_distance, data.radius <= 0.0};
+
+    // the best results so far, the worst of them is always on top
+    ResultSet results{data};
+
+    std::vector<std::pair<double, std::size_t>> const tile_order = order_tiles(ctx, stats);
+
+    // decompressed tiles, the results point into them until they are materialized
+    std::vector<std::shared_ptr<std::string const>> buffers;
+    if (data.parallel && !tile_order.empty()) {
+        // every tile is decompressed and scanned on its own with its own results, the candidates
+        // they offered are then offered again to the query's results in the serial order, so the
+        // results are the same as scanning the tiles one after the other
+        thread_pool& pool = thread_pool::shared();
+        // the calling thread runs tasks as well
+        std::size_t const max_chunks = 2 * (pool.size() + 1);
+        std::vector<std::vector<ResultObject>> candidates(tile_order.size());
+        std::vector<std::vector<LayerChunk>> tile_chunks(tile_order.size());
+        buffers.resize(tile_order.size());
+        pool.parallel_for(tile_order.size(), [&](std::size_t i) {
+            TileObject const& tile_obj = *data.tiles[tile_order[i].second];
+            vtzero::data_view tile_data = tile_obj.data;
+            if (tile_decompressor::is_compressed(tile_obj.data)) {
+                tile_decompressor decompressor;
+                buffers[i] = decompress_tile(tile_obj.data, decompressor);
+                tile_data = vtzero::data_view{*buffers[i]};
+            }
+            ResultSet tile_results{data};
+            scan_tile(ctx, tile_order[i].second, tile_order[i].first, tile_data, tile_results, &candidates[i], &tile_chunks[i], max_chunks);
+        });
+        // then the ranges of the large layers, each with its own results as well
+        std::vector<LayerChunk*> chunks;
+        for (auto& tile_chunk : tile_chunks) {
+            for (auto& chunk : tile_chunk) {
+                chunks.push_back(&chunk);
+            }
+        }
+        pool.parallel_for(chunks.size(), [&](std::size_t i) {
+            LayerChunk& chunk = *chunks[i];
+            ResultSet chunk_results{data};
+            LayerFilter layer_filter{ctx.filter_program, chunk.layer};
+            LayerScan layer_scan{ctx, chunk.tile_index, chunk.layer, chunk.layer_index, layer_filter};
+            for (std::size_t feature_index = chunk.begin; feature_index < chunk.end; ++feature_index) {
+                vtzero::data_view const feature_data = (*chunk.features)[feature_index];
+                vtzero::feature feature{&chunk.layer, feature_data};
+                layer_scan.scan(feature, feature_data, feature_index, chunk_results, &chunk.candidates);
+            }
+        });
+        for (std::size_t i = 0; i < tile_order.size(); ++i) {
+            if (tile_chunks[i].empty()) {
+                continue;
+            }
+            for (auto& chunk : tile_chunks[i]) {
+                std::move(chunk.candidates.begin(), chunk.candidates.end(), std::back_inserter(candidates[i]));
+            }
+            std::sort(candidates[i].begin(), candidates[i].end(), [](ResultObject const& a, ResultObject const& b) {
+                return a.position < b.position;
+            });
+        }
+        offer_candidates(ctx, tile_order, candidates, results, stats);
+    } else {
+        tile_decompressor decompressor;
+        buffers.reserve(tile_order.size());
+        // for each tile
+        for (auto const& tile_entry : tile_order) {
+            double const tile_min_distance = tile_entry.first;
+            TileObject const& tile_obj = *data.tiles[tile_entry.second];
+            if (ctx.shrink_radius && out_of_reach(tile_min_distance, results.max_distance())) {
+                ++stats.tiles_skipped;
+                continue;
+            }
+
+            if (data.streaming && gzip::is_compressed(tile_obj.data.data(), tile_obj.data.size()) && !tile_cache::shared().enabled()) {
+                scan_streamed_tile(ctx, tile_entry.second, tile_min_distance, tile_obj.data, results, buffers);
+                continue;
+            }
+            vtzero::data_view tile_data = tile_obj.data;
+            if (tile_decompressor::is_compressed(tile_obj.data)) {
+                buffers.push_back(decompress_tile(tile_obj.data, decompressor));
+                tile_data = vtzero::data_view{*buffers.back()};
+            }
+            scan_tile(ctx, tile_entry.second, tile_min_distance, tile_data, results, nullptr);
+        }
+    }
+    return finish_results(ctx, results);
+}
+
+/*
+  Query points in the coordinates of a tile layer, bucketed by a grid of `cells` x `cells` over its
+  extent to find the ones near a box. Points outside of the tile are put in the cells on its edge,
+  they are still found since their distance to a box can only grow that way.
+*/
+class PointGrid {
+  public:
+    PointGrid(std::vector<mapbox::geometry::point<std::int64_t>> const& points, std::uint32_t extent, std::int64_t cells)
+        : cells_(cells),
+          cell_size_(static_cast<double>(std::max<std::int64_t>(1, (extent + cells - 1) / cells))),
+          offsets_(static_cast<std::size_t>(cells * cells) + 1, 0),
+          indexes_(points.size()) {
+        std::vector<std::size_t> point_cells;
+        point_cells.reserve(points.size());
+        for (auto const& point : points) {
+            point_cells.push_back(static_cast<std::size_t>(cell(static_cast<double>(point.y)) * cells_ + cell(static_cast<double>(point.x))));
+            ++offsets_[point_cells.back() + 1];
+        }
+        for (std::size_t i = 1; i < offsets_.size(); ++i) {
+            offsets_[i] += offsets_[i - 1];
+        }
+        std::vector<std::size_t> next(offsets_.begin(), offsets_.end() - 1);
+        for (std::size_t i = 0; i < point_cells.size(); ++i) {
+            indexes_[next[point_cells[i]]++] = i;
+        }
+    }
+
+    /// the first and last column (or row) of the cells that coordinates from `min` to `max` fall in
+    std::pair<std::int64_t, std::int64_t> cells(double min, double max) const {
+        return {cell(min), cell(max)};
+    }
+
+    /// call `f(index)` for the points in the cells of these columns and rows
+    template <typename F>
+    void for_each_in(std::pair<std::int64_t, std::int64_t> columns, std::pair<std::int64_t, std::int64_t> rows, F&& f) const {
+        for (std::int64_t y = rows.first; y <= rows.second; ++y) {
+            auto const row = static_cast<std::size_t>(y * cells_);
+            for (std::size_t i = offsets_[row + static_cast<std::size_t>(columns.first)]; i < offsets_[row + static_cast<std::size_t>(columns.second) + 1]; ++i) {
+                f(indexes_[i]);
+            }
+        }
+    }
+
+  private:
+    /// the column or row of a coordinate, clamped to the grid
+    std::int64_t cell(double coordinate) const {
+        double const c = std::floor(coordinate / cell_size_);
+        if (!(c > 0.0)) {
+            return 0;
+        }
+        return c < static_cast<double>(cells_ - 1) ? static_cast<std::int64_t>(c) : cells_ - 1;
+    }
+
+    std::int64_t cells_;
+    double cell_size_;
+    // the points of each cell are indexes_[offsets_[cell]] to indexes_[offsets_[cell + 1] - 1], the
+    // cells of a row are next to each other so a range of them is a single range of points
+    std::vector<std::size_t> offsets_;
+    std::vector<std::size_t> indexes_;
+};
+
+/// a query point of a batch that scans a tile, with results of its own (see offer_candidates)
+struct TileScan {
+    std::size_t point;
+    double tile_min_distance;
+    ResultSet results;
+    std::vector<ResultObject>* candidates;
+};
+
+/*
+  Scan a tile for a group of query points at once, like scan_tile does for each of them. The
+  features are decoded once and only measured for the points whose grid cell is near their
+  bounding box, and only for the points the bounding box itself is within reach of.
+*/
+void scan_tile_group(std::vector<ScanContext> const& ctxs, std::size_t tile_index, std::vector<TileScan>& scans) {
+    QueryData const& data = ctxs.front().data;
+    TileObject const& tile_obj = *data.tiles[tile_index];
+    if (scans.size() == 1) {
+        // nothing to share, this can use the spatial index of the tile if it has one
+        TileScan& scan = scans.front();
+        scan_tile(ctxs[scan.point], tile_index, scan.tile_min_distance, tile_obj.data, scan.results, scan.candidates);
+        return;
+    }
+    decoded_geometry geometry;
+    std::vector<TileScan*> active;
+    std::vector<LayerScan> layer_scans;
+    std::vector<mapbox::geometry::point<std::int64_t>> query_points;
+    vtzero::vector_tile tile{tile_obj.data};
+    std::uint64_t layer_index = 0;
+    while (auto layer = next_layer(tile_obj, tile, layer_index)) {
+        // the points the remaining layers of this tile are all out of reach of are done
+        active.clear();
+        for (auto& scan : scans) {
+            if (!ctxs[scan.point].shrink_radius || !out_of_reach(scan.tile_min_distance, scan.results.max_distance())) {
+                active.push_back(&scan);
+            }
+        }
+        if (active.empty()) {
+            break;
+        }
+        if (layer_selected(data, layer)) {
+            LayerFilter layer_filter{ctxs.front().filter_program, layer};
+            layer_scans.clear();
+            query_points.clear();
+            // the results only get closer while the layer is scanned
+            double reach = 0.0;
+            for (TileScan* scan : active) {
+                layer_scans.emplace_back(ctxs[scan->point], tile_index, layer, layer_index, layer_filter);
+                query_points.push_back(layer_scans.back().query_point());
+                reach = std::max(reach, layer_scans.back().reach(scan->results));
+            }
+            PointGrid const grid{query_points, layer.extent(), point_grid_cells};
+            std::uint64_t feature_index = 0;
+            for_each_feature(layer, [&](vtzero::feature const& feature, vtzero::data_view feature_data) {
+                std::uint64_t const index = feature_index++;
+                GeomType const geometry_type = get_geometry_type(feature);
+                if (!feature_selected(data, layer_filter, feature, geometry_type)) {
+                    return;
+                }
+                geometry.decode(feature);
+                if (geometry.empty()) {
+                    return;
+                }
+                auto const columns = grid.cells(geometry.min_x() - reach, geometry.max_x() + reach);
+                auto const rows = grid.cells(geometry.min_y() - reach, geometry.max_y() + reach);
+                grid.for_each_in(columns, rows, [&](std::size_t i) {
+                    layer_scans[i].scan(feature, feature_data, geometry_type, geometry, index, active[i]->results, active[i]->candidates);
+                });
+            });
+        }
+        ++layer_index;
+    }
+}
+
+/*
+  The results of a batch of query points over tiles that are loaded (see load_batch_tiles), in the
+  order of the points, each the same as a query of that point. Every tile is scanned by groups of
+  the points that visit it on the thread pool, each point with results of its own for the tile.
+  Then every point offers the candidates its tiles found to its results, in its visiting order.
+*/
+std::vector<std::vector<ResultObject>> batch_query(QueryData const& data,
+                                                   std::vector<mapbox::geometry::point<double>> const& points,
+                                                   std::vector<QueryStats>& stats) {
+    FilterProgram const filter_program{data.basic_filter};
+    std::vector<mapbox::cheap_ruler::CheapRuler> rulers;
+    rulers.reserve(points.size());
+    std::vector<ScanContext> ctxs;
+    ctxs.reserve(points.size());
+    for (auto const& point : points) {
+        rulers.emplace_back(point.y, mapbox::cheap_ruler::CheapRuler::Meters);
+        ctxs.push_back(ScanContext{data, filter_program, rulers.back(), point, !data.tile_distance, data.radius <= 0.0});
+    }
+
+    // the tiles every point visits, where the candidates they find go, and the points visiting
+    // every tile (the point and the position of the tile in its order)
+    std::vector<std::vector<std::pair<double, std::size_t>>> tile_orders(points.size());
+    std::vector<std::vector<std::vector<ResultObject>>> candidates(points.size());
+    std::vector<std::vector<std::pair<std::size_t, std::size_t>>> tile_points(data.tiles.size());
+    std::size_t visits = 0;
+    for (std::size_t point = 0; point < points.size(); ++point) {
+        tile_orders[point] = order_tiles(ctxs[point], stats[point]);
+        candidates[point].resize(tile_orders[point].size());
+        for (std::size_t i = 0; i < tile_orders[point].size(); ++i) {
+            tile_points[tile_orders[point][i].second].emplace_back(point, i);
+        }
+        visits += tile_orders[point].size();
+    }
+
+    // enough groups to keep the pool busy, but each one large enough to share the decoding
+    thread_pool& pool = thread_pool::shared();
+    std::size_t const target_groups = 2 * (pool.size() + 1);
+    std::size_t const group_size = std::max(min_group_points, (visits + target_groups - 1) / target_groups);
+    std::vector<std::pair<std::size_t, std::size_t>> groups; // tile index and first point
+    for (std::size_t tile_index = 0; tile_index < tile_points.size(); ++tile_index) {
+        for (std::size_t begin = 0; begin < tile_points[tile_index].size(); begin += group_size) {
+            groups.emplace_back(tile_index, begin);
+        }
+    }
+    pool.parallel_for(groups.size(), [&](std::size_t g) {
+        std::size_t const tile_index = groups[g].first;
+        auto const& visitors = tile_points[tile_index];
+        std::size_t const end = std::min(visitors.size(), groups[g].second + group_size);
+        std::vector<TileScan> scans;
+        scans.reserve(end - groups[g].second);
+        for (std::size_t i = groups[g].second; i < end; ++i) {
+            std::size_t const point = visitors[i].first;
+            std::size_t const position = visitors[i].second;
+            scans.push_back(TileScan{point, tile_orders[point][position].first, ResultSet{data}, &candidates[point][position]});
+        }
+        scan_tile_group(ctxs, tile_index, scans);
+    });
+
+    std::vector<std::vector<ResultObject>> results(points.size());
+    pool.parallel_for(points.size(), [&](std::size_t point) {
+        ResultSet point_results{data};
+        offer_candidates(ctxs[point], tile_orders[point], candidates[point], point_results, stats[point]);
+        results[point] = finish_results(ctxs[point], point_results);
+    });
+    return results;
+}
+
+/// the result of a spatial join (see join_points)
+struct JoinResult {
+    // the polygon features that contain at least one of the points, with their properties materialized
+    std::vector<ResultObject> features;
+    // the features of point i are features[indexes[j]] for j from offsets[i] to offsets[i + 1] - 1
+    std::vector<std::uint32_t> offsets;
+    std::vector<std::uint32_t> indexes;
+};
+
+/// a polygon feature of a spatial join, its rings are decoded once for all of the points
+struct JoinPolygon {
+    // a feature of a layer of the loaded tile, and the data it was read from
+    vtzero::feature feature;
+    vtzero::data_view feature_data;
+    vtzero::layer const* layer;
+    decoded_geometry geometry;
+    // the grid of the points in the coordinates of the layer's extent
+    std::size_t grid;
+    // the slabs of the layer and the index of the feature in it, large polygons test the points with them
+    lazy_polygon_slabs const* slabs;
+    std::uint64_t feature_index;
+};
+
+/// a band of grid rows that a polygon tests the points of
+struct JoinTask {
+    std::size_t polygon;
+    std::pair<std::int64_t, std::int64_t> columns;
+    std::pair<std::int64_t, std::int64_t> rows;
+};
+
+/*
+  Spatial join of `points` (longitude, latitude, longitude, ...) against the polygons of the
+  selected layers of a tile: which polygon features contain each point. The features of every
+  point are in the order of the tile.
+
+  The polygons are decoded once and each one only tests the points in the grid cells that its
+  bounding box overlaps. Tasks are bands of rows of a polygon rather than whole polygons, so a
+  polygon that covers most of the points is spread over the thread pool as well.
+*/
+JoinResult join_points(QueryData const& data, std::vector<double> const& points) {
+    TileObject const& tile_obj = *data.tiles.front();
+    std::size_t const num_points = points.size() / 2;
+    auto const cells = std::min(max_join_grid_cells,
+                                std::max<std::int64_t>(1, static_cast<std::int64_t>(std::sqrt(static_cast<double>(num_points / join_points_per_cell)))));
+
+    // the points in the coordinates of every extent the layers use, usually only one
+    std::vector<std::uint32_t> extents;
+    std::vector<std::vector<mapbox::geometry::point<std::int64_t>>> grid_points;
+    std::vector<PointGrid> grids;
+
+    // the tile is loaded (see JoinWorker), the polygons point into its layers
+    std::vector<JoinPolygon> polygons;
+    auto const& layers = tile_obj.handle->layers;
+    for (std::size_t layer_index = 0; layer_index < layers.size(); ++layer_index) {
+        vtzero::layer const& layer = layers[layer_index];
+        if (!layer_selected(data, layer)) {
+            continue;
+        }
+        auto const extent_it = std::find(extents.begin(), extents.end(), layer.extent());
+        std::size_t const grid = static_cast<std::size_t>(std::distance(extents.begin(), extent_it));
+        if (extent_it == extents.end()) {
+            extents.push_back(layer.extent());
+            grid_points.emplace_back();
+            grid_points.back().reserve(num_points);
+            for (std::size_t i = 0; i < num_points; ++i) {
+                grid_points.back().push_back(utils::create_query_point(points[2 * i], points[2 * i + 1], layer.extent(), tile_obj.z, tile_obj.x, tile_obj.y));
+            }
+            grids.emplace_back(grid_points.back(), layer.extent(), cells);
+        }
+        lazy_polygon_slabs const* const slabs = layer_slabs(tile_obj, layer_index);
+        std::uint64_t feature_index = 0;
+        for_each_feature(layer, [&](vtzero::feature const& feature, vtzero::data_view feature_data) {
+            std::uint64_t const index = feature_index++;
+            if (feature.geometry_type() != vtzero::GeomType::POLYGON) {
+                return;
+            }
+            polygons.push_back(JoinPolygon{feature, feature_data, &layer, {}, grid, slabs, index});
+            polygons.back().geometry.decode(feature);
+            if (polygons.back().geometry.empty()) {
+                polygons.pop_back();
+            }
+        });
+    }
+
+    std::vector<JoinTask> tasks;
+    for (std::size_t p = 0; p < polygons.size(); ++p) {
+        auto const& geometry = polygons[p].geometry;
+        PointGrid const& grid = grids[polygons[p].grid];
+        auto const columns = grid.cells(geometry.min_x(), geometry.max_x());
+        auto const rows = grid.cells(geometry.min_y(), geometry.max_y());
+        for (std::int64_t row = rows.first; row <= rows.second; row += join_band_rows) {
+            tasks.push_back(JoinTask{p, columns, {row, std::min(rows.second, row + join_band_rows - 1)}});
+        }
+    }
+
+    // the points every task found within its polygon
+    std::vector<std::vector<std::uint32_t>> matches(tasks.size());
+    thread_pool::shared().parallel_for(tasks.size(), [&](std::size_t t) {
+        JoinPolygon const& polygon = polygons[tasks[t].polygon];
+        auto const& query_points = grid_points[polygon.grid];
+        polygon_slabs const* slabs = polygon.slabs != nullptr ? polygon.slabs->get(polygon.feature_index, polygon.feature) : nullptr;
+        grids[polygon.grid].for_each_in(tasks[t].columns, tasks[t].rows, [&](std::size_t i) {
+            if (polygon.geometry.squared_distance(query_points[i]) > 0.0) {
+                return;
+            }
+            if (slabs != nullptr ? slabs->contains(query_points[i]) : feature_contains(polygon.geometry, query_points[i])) {
+                matches[t].push_back(static_cast<std::uint32_t>(i));
+            }
+        });
+    });
+
+    // number the polygons that contain any point, and count the features of every point
+    JoinResult result;
+    LayerCache result_layers;
+    result.offsets.assign(num_points + 1, 0);
+    std::vector<std::uint32_t> feature_indexes(polygons.size(), std::numeric_limits<std::uint32_t>::max());
+    std::uint64_t total = 0;
+    for (std::size_t t = 0; t < tasks.size(); ++t) {
+        if (matches[t].empty()) {
+            continue;
+        }
+        JoinPolygon const& polygon = polygons[tasks[t].polygon];
+        std::uint32_t& feature_index = feature_indexes[tasks[t].polygon];
+        if (feature_index == std::numeric_limits<std::uint32_t>::max()) {
+            feature_index = static_cast<std::uint32_t>(result.features.size());
+            result.features.emplace_back();
+            ResultObject& feature = result.features.back();
+            feature.layer_data = polygon.layer->data();
+            feature.feature_data = polygon.feature_data;
+            feature.layer_name = std::string(polygon.layer->name());
+            feature.original_geometry_type = GeomType::polygon;
+            feature.has_id = polygon.feature.has_id();
+            feature.id = polygon.feature.id();
+            materialize_properties(feature, result_layers, data);
+        }
+        for (auto const i : matches[t]) {
+            ++result.offsets[i + 1];
+        }
+        total += matches[t].size();
+    }
+    if (total > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::runtime_error("the points are contained by too many polygons to fit in a Uint32Array");
+    }
+    for (std::size_t i = 1; i < result.offsets.size(); ++i) {
+        result.offsets[i] += result.offsets[i - 1];
+    }
+    // tasks are in the order of the polygons, a point is in a single band of every polygon
+    result.indexes.resize(total);
+    std::vector<std::uint32_t> next(result.offsets.begin(), result.offsets.end() - 1);
+    for (std::size_t t = 0; t < tasks.size(); ++t) {
+        for (auto const i : matches[t]) {
+            result.indexes[next[i]++] = feature_indexes[tasks[t].polygon];
+        }
+    }
+    return result;
+}
+
+/// the v8 (GeoJSON) FeatureCollection of the results of a query, this empties `results`
+v8::Local<v8::Object> create_feature_collection(std::vector<ResultObject>& results) {
+    v8::Local<v8::Object> results_object = Nan::New<v8::Object>();
+    v8::Local<v8::Array> features_array = Nan::New<v8::Array>();
+    Nan::Set(results_object, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("FeatureCollection").ToLocalChecked());
+
+    // for each result object
+    while (!results.empty()) {
+        auto const& feature = results.back(); // get reference to top item in results queue
+        if (feature.distance < std::numeric_limits<double>::max()) {
+            // if this is a default value, don't use it
+            v8::Local<v8::Object> feature_obj = Nan::New<v8::Object>();
+            Nan::Set(feature_obj, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("Feature").ToLocalChecked());
+            Nan::Set(feature_obj, Nan::New("id").ToLocalChecked(), Nan::New<v8::Number>(feature.id));
+
+            // create geometry object
+            v8::Local<v8::Object> geometry_obj = Nan::New<v8::Object>();
+            Nan::Set(geometry_obj, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("Point").ToLocalChecked());
+            v8::Local<v8::Array> coordinates_array = Nan::New<v8::Array>(2);
+            Nan::Set(coordinates_array, 0, Nan::New<v8::Number>(feature.coordinates.x)); // latitude
+            Nan::Set(coordinates_array, 1, Nan::New<v8::Number>(feature.coordinates.y)); // longitude
+            Nan::Set(geometry_obj, Nan::New("coordinates").ToLocalChecked(), coordinates_array);
+            Nan::Set(feature_obj, Nan::New("geometry").ToLocalChecked(), geometry_obj);
+
+            // create properties object
+            v8::Local<v8::Object> properties_obj = Nan::New<v8::Object>();
+            for (auto const& prop : feature.properties_vector_materialized) {
+                set_property(prop, properties_obj);
+            }
+
+            // set properties.tilquery
+            v8::Local<v8::Object> tilequery_properties_obj = Nan::New<v8::Object>();
+            Nan::Set(tilequery_properties_obj, Nan::New("distance").ToLocalChecked(), Nan::New<v8::Number>(feature.distance));
+            std::string og_geom = getGeomTypeString(feature.original_geometry_type);
+            Nan::Set(tilequery_properties_obj, Nan::New("geometry").ToLocalChecked(), Nan::New<v8::String>(og_geom).ToLocalChecked());
+            Nan::Set(tilequery_properties_obj, Nan::New("layer").ToLocalChecked(), Nan::New<v8::String>(feature.layer_name).ToLocalChecked());
+            Nan::Set(properties_obj, Nan::New("tilequery").ToLocalChecked(), tilequery_properties_obj);
+
+            // add properties to feature
+            Nan::Set(feature_obj, Nan::New("properties").ToLocalChecked(), properties_obj);
+
+            // add feature to features array
+            Nan::Set(features_array, static_cast<uint32_t>(results.size() - 1), feature_obj);
+        }
+
+        results.pop_back();
+    }
+
+    Nan::Set(results_object, Nan::New("features").ToLocalChecked(), features_array);
+    return results_object;
+}
+
+/// add the `tilequery` object of the `stats` option to a FeatureCollection
+void set_stats(QueryStats const& stats, v8::Local<v8::Object>& results_object) {
+    v8::Local<v8::Object> stats_obj = Nan::New<v8::Object>();
+    Nan::Set(stats_obj, Nan::New("tiles").ToLocalChecked(), Nan::New<v8::Number>(stats.tiles));
+    Nan::Set(stats_obj, Nan::New("tiles_skipped").ToLocalChecked(), Nan::New<v8::Number>(stats.tiles_skipped));
+    Nan::Set(results_object, Nan::New("tilequery").ToLocalChecked(), stats_obj);
+}
+
+/// main worker used by NAN
+struct Worker : Nan::AsyncWorker {
+    using Base = Nan::AsyncWorker;
+
+    /// set up major containers
+    std::unique_ptr<QueryData> query_data_;
+    std::vector<ResultObject> results_queue_;
+    QueryStats stats_;
+
+    Worker(std::unique_ptr<QueryData> query_data,
+           Nan::Callback* cb)
+        : Base(cb, "vtquery:worker"),
+          query_data_(std::move(query_data)) {}
+
+    void Execute() override {
+        try {
+            QueryData const& data = *query_data_;
+            results_queue_ = query_point(data, {data.longitude, data.latitude}, stats_);
+        } catch (std::exception const& e) {
+            SetErrorMessage(e.what());
+        }
+    }
+
+    void HandleOKCallback() override {
+        Nan::HandleScope scope;
+        try {
+            v8::Local<v8::Object> results_object = create_feature_collection(results_queue_);
+
+            if (query_data_->stats) {
+                set_stats(stats_, results_object);
+            }
+
+            auto const argc = 2u;
+            v8::Local<v8::Value> argv[argc] = {
+                Nan::Null(), results_object};
+
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+
+        } catch (const std::exception& e) {
+            // unable to create test to throw exception here, the try/catch is simply
+            // for unexpected cases https://github.com/mapbox/vtquery/issues/69
+            // LCOV_EXCL_START
+            auto const argc = 1u;
+            v8::Local<v8::Value> argv[argc] = {Nan::Error(e.what())};
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+            // LCOV_EXCL_STOP
+        }
+    }
+};
+
+/*
+  Tiles of a batch are loaded once, in place, like a VectorTileHandle without an index, so the
+  queries of all points share them. Tiles that are out of the radius of every point are left
+  alone, none of the queries would read them.
+*/
+void load_batch_tiles(QueryData& data, std::vector<mapbox::geometry::point<double>> const& points) {
+    std::vector<mapbox::cheap_ruler::CheapRuler> rulers;
+    rulers.reserve(points.size());
+    for (auto const& point : points) {
+        rulers.emplace_back(point.y, mapbox::cheap_ruler::CheapRuler::Meters);
+    }
+    std::vector<std::size_t> tiles_to_load;
+    for (std::size_t tile_index = 0; tile_index < data.tiles.size(); ++tile_index) {
+        TileObject const& tile_obj = *data.tiles[tile_index];
+        if (tile_obj.handle) {
+            continue;
+        }
+        for (std::size_t i = 0; i < points.size(); ++i) {
+            if (!out_of_reach(utils::tile_min_distance(rulers[i], points[i], tile_obj.bounds), data.radius)) {
+                tiles_to_load.push_back(tile_index);
+                break;
+            }
+        }
+    }
+    thread_pool::shared().parallel_for(tiles_to_load.size(), [&](std::size_t i) {
+        TileObject& tile_obj = *data.tiles[tiles_to_load[i]];
+        tile_obj.handle = load_tile(tile_obj.z, tile_obj.x, tile_obj.y, tile_obj.data, false);
+        tile_obj.data = vtzero::data_view{tile_obj.handle->buffer};
+    });
+}
+
+/// worker of vtquery.batch(), the tiles are scanned for groups of points on the thread pool (see batch_query)
+struct BatchWorker : Nan::AsyncWorker {
+    using Base = Nan::AsyncWorker;
+
+    std::unique_ptr<QueryData> query_data_;
+    std::vector<mapbox::geometry::point<double>> points_;
+    // results and stats of every point
+    std::vector<std::vector<ResultObject>> results_;
+    std::vector<QueryStats> stats_;
+
+    BatchWorker(std::unique_ptr<QueryData> query_data,
+                std::vector<mapbox::geometry::point<double>> points,
+                Nan::Callback* cb)
+        : Base(cb, "vtquery:batch"),
+          query_data_(std::move(query_data)),
+          points_(std::move(points)) {}
+
+    void Execute() override {
+        try {
+            load_batch_tiles(*query_data_, points_);
+            stats_.resize(points_.size());
+            results_ = batch_query(*query_data_, points_, stats_);
+        } catch (std::exception const& e) {
+            SetErrorMessage(e.what());
+        }
+    }
+
+    void HandleOKCallback() override {
+        Nan::HandleScope scope;
+        try {
+            v8::Local<v8::Array> results_array = Nan::New<v8::Array>(static_cast<std::uint32_t>(results_.size()));
+            for (std::size_t i = 0; i < results_.size(); ++i) {
+                v8::Local<v8::Object> results_object = create_feature_collection(results_[i]);
+                if (query_data_->stats) {
+                    set_stats(stats_[i], results_object);
+                }
+                Nan::Set(results_array, static_cast<std::uint32_t>(i), results_object);
+            }
+
+            auto const argc = 2u;
+            v8::Local<v8::Value> argv[argc] = {
+                Nan::Null(), results_array};
+
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+
+        } catch (const std::exception& e) {
+            // LCOV_EXCL_START
+            auto const argc = 1u;
+            v8::Local<v8::Value> argv[argc] = {Nan::Error(e.what())};
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+            // LCOV_EXCL_STOP
+        }
+    }
+};
+
+/// a Uint32Array with a copy of `values`
+v8::Local<v8::Object> create_uint32_array(std::vector<std::uint32_t> const& values) {
+    std::size_t const bytes = values.size() * sizeof(std::uint32_t);
+    v8::Local<v8::Object> buffer = Nan::CopyBuffer(reinterpret_cast<char const*>(values.data()), static_cast<std::uint32_t>(bytes)).ToLocalChecked();
+    v8::Local<v8::Uint8Array> bytes_array = buffer.As<v8::Uint8Array>();
+    return v8::Uint32Array::New(bytes_array->Buffer(), bytes_array->ByteOffset(), values.size());
+}
+
+/// worker of vtquery.join(), the polygons of the tile test the points on the thread pool (see join_points)
+struct JoinWorker : Nan::AsyncWorker {
+    using Base = Nan::AsyncWorker;
+
+    std::unique_ptr<QueryData> query_data_;
+    std::vector<double> points_;
+    JoinResult result_;
+
+    JoinWorker(std::unique_ptr<QueryData> query_data,
+               std::vector<double> points,
+               Nan::Callback* cb)
+        : Base(cb, "vtquery:join"),
+          query_data_(std::move(query_data)),
+          points_(std::move(points)) {}
+
+    void Execute() override {
+        try {
+            TileObject& tile_obj = *query_data_->tiles.front();
+            if (!tile_obj.handle) {
+                tile_obj.handle = load_tile(tile_obj.z, tile_obj.x, tile_obj.y, tile_obj.data, false);
+                tile_obj.data = vtzero::data_view{tile_obj.handle->buffer};
+            }
+            result_ = join_points(*query_data_, points_);
+        } catch (std::exception const& e) {
+            SetErrorMessage(e.what());
+        }
+    }
+
+    void HandleOKCallback() override {
+        Nan::HandleScope scope;
+        try {
+            v8::Local<v8::Object> results_object = Nan::New<v8::Object>();
+            v8::Local<v8::Array> features_array = Nan::New<v8::Array>(static_cast<std::uint32_t>(result_.features.size()));
+            for (std::size_t i = 0; i < result_.features.size(); ++i) {
+                auto const& feature = result_.features[i];
+                v8::Local<v8::Object> feature_obj = Nan::New<v8::Object>();
+                Nan::Set(feature_obj, Nan::New("type").ToLocalChecked(), Nan::New<v8::String>("Feature").ToLocalChecked());
+                Nan::Set(feature_obj, Nan::New("id").ToLocalChecked(), Nan::New<v8::Number>(feature.id));
+                Nan::Set(feature_obj, Nan::New("geometry").ToLocalChecked(), Nan::Null());
+
+                v8::Local<v8::Object> properties_obj = Nan::New<v8::Object>();
+                for (auto const& prop : feature.properties_vector_materialized) {
+                    set_property(prop, properties_obj);
+                }
+                v8::Local<v8::Object> tilequery_properties_obj = Nan::New<v8::Object>();
+                Nan::Set(tilequery_properties_obj, Nan::New("geometry").ToLocalChecked(), Nan::New<v8::String>(getGeomTypeString(feature.original_geometry_type)).ToLocalChecked());
+                Nan::Set(tilequery_properties_obj, Nan::New("layer").ToLocalChecked(), Nan::New<v8::String>(feature.layer_name).ToLocalChecked());
+                Nan::Set(properties_obj, Nan::New("tilequery").ToLocalChecked(), tilequery_properties_obj);
+                Nan::Set(feature_obj, Nan::New("properties").ToLocalChecked(), properties_obj);
+
+                Nan::Set(features_array, static_cast<std::uint32_t>(i), feature_obj);
+            }
+            Nan::Set(results_object, Nan::New("features").ToLocalChecked(), features_array);
+            Nan::Set(results_object, Nan::New("offsets").ToLocalChecked(), create_uint32_array(result_.offsets));
+            Nan::Set(results_object, Nan::New("indexes").ToLocalChecked(), create_uint32_array(result_.indexes));
+
+            auto const argc = 2u;
+            v8::Local<v8::Value> argv[argc] = {
+                Nan::Null(), results_object};
+
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+
+        } catch (const std::exception& e) {
+            // LCOV_EXCL_START
+            auto const argc = 1u;
+            v8::Local<v8::Value> argv[argc] = {Nan::Error(e.what())};
+            callback->Call(argc, static_cast<v8::Local<v8::Value>*>(argv), async_resource);
+            // LCOV_EXCL_STOP
+        }
+    }
+};
+
+/// read a tile object (or VectorTileHandle) and add it to `query_data`, returns an error message if it is not valid
+char const* parse_tile(v8::Local<v8::Value> tile_val, QueryData& query_data) {
+    if (!tile_val->IsObject()) {
+        return "items in 'tiles' array must be objects";
+    }
+    // tiles loaded ahead of time, already decompressed and parsed
+    if (VectorTileHandle::HasInstance(tile_val)) {
+        auto const* handle = Nan::ObjectWrap::Unwrap<VectorTileHandle>(tile_val.As<v8::Object>());
+        query_data.tiles.push_back(std::make_unique<TileObject>(handle->data()));
+        return nullptr;
+    }
+    v8::Local<v8::Object> tile_obj = tile_val->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+    // check buffer value
+    if (!Nan::Has(tile_obj, Nan::New("buffer").ToLocalChecked()).FromMaybe(false)) {
+        return "item in 'tiles' array does not include a buffer value";
+    }
+    v8::Local<v8::Value> buf_val = Nan::Get(tile_obj, Nan::New("buffer").ToLocalChecked()).ToLocalChecked();
+    if (buf_val->IsNull() || buf_val->IsUndefined()) {
+        return "buffer value in 'tiles' array item is null or undefined";
+    }
+    v8::Local<v8::Object> buffer = buf_val->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+    if (!node::Buffer::HasInstance(buffer)) {
+        return "buffer value in 'tiles' array item is not a true buffer";
+    }
+
+    // z value
+    if (!Nan::Has(tile_obj, Nan::New("z").ToLocalChecked()).FromMaybe(false)) {
+        return "item in 'tiles' array does not include a 'z' value";
+    }
+    v8::Local<v8::Value> z_val = Nan::Get(tile_obj, Nan::New("z").ToLocalChecked()).ToLocalChecked();
+    if (!z_val->IsInt32()) {
+        return "'z' value in 'tiles' array item is not an int32";
+    }
+    std::int32_t z = Nan::To<std::int32_t>(z_val).FromJust();
+    if (z < 0) {
+        return "'z' value must not be less than zero";
+    }
+
+    // x value
+    if (!Nan::Has(tile_obj, Nan::New("x").ToLocalChecked()).FromMaybe(false)) {
+        return "item in 'tiles' array does not include a 'x' value";
+    }
+    v8::Local<v8::Value> x_val = Nan::Get(tile_obj, Nan::New("x").ToLocalChecked()).ToLocalChecked();
+    if (!x_val->IsInt32()) {
+        return "'x' value in 'tiles' array item is not an int32";
+    }
+    std::int32_t x = Nan::To<std::int32_t>(x_val).FromJust();
+    if (x < 0) {
+        return "'x' value must not be less than zero";
+    }
+
+    // y value
+    if (!Nan::Has(tile_obj, Nan::New("y").ToLocalChecked()).FromMaybe(false)) {
+        return "item in 'tiles' array does not include a 'y' value";
+    }
+    v8::Local<v8::Value> y_val = Nan::Get(tile_obj, Nan::New("y").ToLocalChecked()).ToLocalChecked();
+    if (!y_val->IsInt32()) {
+        return "'y' value in 'tiles' array item is not an int32";
+    }
+    std::int32_t y = Nan::To<std::int32_t>(y_val).FromJust();
+    if (y < 0) {
+        return "'y' value must not be less than zero";
+    }
+
+    // in-place construction
+    std::unique_ptr<TileObject> tile{new TileObject{z, x, y, buffer}};
+    query_data.tiles.push_back(std::move(tile));
+    return nullptr;
+}
+
+/// read the tiles array into `query_data`, returns an error message if it is not valid
+char const* parse_tiles(v8::Local<v8::Array> tiles_arr_val, QueryData& query_data) {
+    unsigned num_tiles = tiles_arr_val->Length();
+    for (unsigned t = 0; t < num_tiles; ++t) {
+        if (auto const* error = parse_tile(Nan::Get(tiles_arr_val, t).ToLocalChecked(), query_data)) {
+            return error;
+        }
+    }
+    return nullptr;
+}
+
+/// read the layers option into `layers`, returns an error message if it is not valid
+char const* parse_layers(v8::Local<v8::Value> layers_val, std::vector<std::string>& layers) {
+    if (!layers_val->IsArray()) {
+        return "'layers' must be an array of strings";
+    }
+
+    v8::Local<v8::Array> layers_arr = layers_val.As<v8::Array>();
+    unsigned num_layers = layers_arr->Length();
+
+    for (unsigned j = 0; j < num_layers; ++j) {
+        v8::Local<v8::Value> layer_val = Nan::Get(layers_arr, j).ToLocalChecked();
+        if (!layer_val->IsString()) {
+            return "'layers' values must be strings";
+        }
+
+        Nan::Utf8String layer_utf8_value(layer_val);
+        int layer_str_len = layer_utf8_value.length();
+        if (layer_str_len <= 0) {
+            return "'layers' values must be non-empty strings";
+        }
+
+        layers.emplace_back(*layer_utf8_value, static_cast<std::size_t>(layer_str_len));
+    }
+    return nullptr;
+}
+
+/// read the properties option into `query_data`, returns an error message if it is not valid
+char const* parse_properties(v8::Local<v8::Value> properties_val, QueryData& query_data) {
+    if (properties_val->IsBoolean()) {
+        // `true` is the default, every property
+        query_data.select_properties = !Nan::To<bool>(properties_val).FromJust();
+        return nullptr;
+    }
+    if (!properties_val->IsArray()) {
+        return "'properties' must be an array of strings or a boolean";
+    }
+
+    v8::Local<v8::Array> properties_arr = properties_val.As<v8::Array>();
+    unsigned num_properties = properties_arr->Length();
+    for (unsigned j = 0; j < num_properties; ++j) {
+        v8::Local<v8::Value> property_val = Nan::Get(properties_arr, j).ToLocalChecked();
+        if (!property_val->IsString()) {
+            return "'properties' values must be strings";
+        }
+
+        Nan::Utf8String property_utf8_value(property_val);
+        query_data.properties.emplace_back(*property_utf8_value, static_cast<std::size_t>(property_utf8_value.length()));
+    }
+    query_data.select_properties = true;
+    return nullptr;
+}
+
+/// read the options object into `query_data`, returns an error message if it is not valid
+/// (defaults are set in the QueryData struct)
+char const* parse_options(v8::Local<v8::Object> options, QueryData& query_data) {
+    if (Nan::Has(options, Nan::New("dedupe").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> dedupe_val = Nan::Get(options, Nan::New("dedupe").ToLocalChecked()).ToLocalChecked();
+        if (!dedupe_val->IsBoolean()) {
+            return "'dedupe' must be a boolean";
+        }
+
+        bool dedupe = Nan::To<bool>(dedupe_val).FromJust();
+        query_data.dedupe = dedupe;
+    }
+
+    if (Nan::Has(options, Nan::New("dedupe_key").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> dedupe_key_val = Nan::Get(options, Nan::New("dedupe_key").ToLocalChecked()).ToLocalChecked();
+        if (!dedupe_key_val->IsString()) {
+            return "'dedupe_key' option must be a string";
+        }
+
+        Nan::Utf8String dedupe_key_utf8_value(dedupe_key_val);
+        std::string dedupe_key(*dedupe_key_utf8_value, static_cast<std::size_t>(dedupe_key_utf8_value.length()));
+        if (dedupe_key == "id") {
+            query_data.dedupe_key = dedupe_id;
+        } else if (dedupe_key == "properties") {
+            query_data.dedupe_key = dedupe_properties;
+        } else if (dedupe_key == "both") {
+            query_data.dedupe_key = dedupe_both;
+        } else {
+            return "'dedupe_key' must be 'id', 'properties', or 'both'";
+        }
+    }
+
+    if (Nan::Has(options, Nan::New("direct_hit_polygon").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> direct_hit_polygon_val = Nan::Get(options, Nan::New("direct_hit_polygon").ToLocalChecked()).ToLocalChecked();
+        if (!direct_hit_polygon_val->IsBoolean()) {
+            return "'direct_hit_polygon' must be a boolean";
+        }
+
+        bool direct_hit_polygon = Nan::To<bool>(direct_hit_polygon_val).FromJust();
+        query_data.direct_hit_polygon = direct_hit_polygon;
+    }
+
+    if (Nan::Has(options, Nan::New("tile_distance").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> tile_distance_val = Nan::Get(options, Nan::New("tile_distance").ToLocalChecked()).ToLocalChecked();
+        if (!tile_distance_val->IsBoolean()) {
+            return "'tile_distance' must be a boolean";
+        }
+
+        query_data.tile_distance = Nan::To<bool>(tile_distance_val).FromJust();
+    }
+
+    if (Nan::Has(options, Nan::New("stats").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> stats_val = Nan::Get(options, Nan::New("stats").ToLocalChecked()).ToLocalChecked();
+        if (!stats_val->IsBoolean()) {
+            return "'stats' must be a boolean";
+        }
+
+        query_data.stats = Nan::To<bool>(stats_val).FromJust();
+    }
+
+    if (Nan::Has(options, Nan::New("parallel").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> parallel_val = Nan::Get(options, Nan::New("parallel").ToLocalChecked()).ToLocalChecked();
+        if (!parallel_val->IsBoolean()) {
+            return "'parallel' must be a boolean";
+        }
+
+        query_data.parallel = Nan::To<bool>(parallel_val).FromJust();
+    }
+
+    if (Nan::Has(options, Nan::New("streaming").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> streaming_val = Nan::Get(options, Nan::New("streaming").ToLocalChecked()).ToLocalChecked();
+        if (!streaming_val->IsBoolean()) {
+            return "'streaming' must be a boolean";
+        }
+
+        query_data.streaming = Nan::To<bool>(streaming_val).FromJust();
+    }
+
+    if (Nan::Has(options, Nan::New("radius").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> radius_val = Nan::Get(options, Nan::New("radius").ToLocalChecked()).ToLocalChecked();
+        if (!radius_val->IsNumber()) {
+            return "'radius' must be a number";
+        }
+
+        double radius = Nan::To<double>(radius_val).FromJust();
+        if (radius < 0.0) {
+            return "'radius' must be a positive number";
+        }
+
+        query_data.radius = radius;
+    }
+
+    if (Nan::Has(options, Nan::New("limit").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> num_results_val = Nan::Get(options, Nan::New("limit").ToLocalChecked()).ToLocalChecked();
+        if (!num_results_val->IsNumber()) {
+            return "'limit' must be a number";
+        }
+
+        std::int32_t num_results = Nan::To<std::int32_t>(num_results_val).FromJust();
+        if (num_results < 1) {
+            return "'limit' must be 1 or greater";
+        }
+        if (num_results > 1000) {
+            return "'limit' must be less than 1000";
+        }
+
+        query_data.num_results = static_cast<std::uint32_t>(num_results);
+    }
+
+    if (Nan::Has(options, Nan::New("layers").ToLocalChecked()).FromMaybe(false)) {
+        if (auto const* error = parse_layers(Nan::Get(options, Nan::New("layers").ToLocalChecked()).ToLocalChecked(), query_data.layers)) {
+            return error;
+        }
+    }
+
+    if (Nan::Has(options, Nan::New("properties").ToLocalChecked()).FromMaybe(false)) {
+        if (auto const* error = parse_properties(Nan::Get(options, Nan::New("properties").ToLocalChecked()).ToLocalChecked(), query_data)) {
+            return error;
+        }
+    }
+
+    if (Nan::Has(options, Nan::New("geometry").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> geometry_val = Nan::Get(options, Nan::New("geometry").ToLocalChecked()).ToLocalChecked();
+        if (!geometry_val->IsString()) {
+            return "'geometry' option must be a string";
+        }
+
+        Nan::Utf8String geometry_utf8_value(geometry_val);
+        std::int32_t geometry_str_len = geometry_utf8_value.length();
+        if (geometry_str_len <= 0) {
+            return "'geometry' value must be a non-empty string";
+        }
+
+        std::string geometry(*geometry_utf8_value, static_cast<std::size_t>(geometry_str_len));
+        if (geometry == "point") {
+            query_data.geometry_filter_type = GeomType::point;
+        } else if (geometry == "linestring") {
+            query_data.geometry_filter_type = GeomType::linestring;
+        } else if (geometry == "polygon") {
+            query_data.geometry_filter_type = GeomType::polygon;
+        } else {
+            return "'geometry' must be 'point', 'linestring', or 'polygon'";
+        }
+    }
+
+    if (Nan::Has(options, Nan::New("basic-filters").ToLocalChecked()).FromMaybe(false)) {
+        v8::Local<v8::Value> basic_filter_val = Nan::Get(options, Nan::New("basic-filters").ToLocalChecked()).ToLocalChecked();
+        if (!basic_filter_val->IsArray()) {
+            return "'basic-filters' must be of the form [type, [filters]]";
+        }
+
+        v8::Local<v8::Array> basic_filter_array = basic_filter_val.As<v8::Array>();
+        unsigned basic_filter_length = basic_filter_array->Length();
+
+        // gather filters from an array
+        if (basic_filter_length == 2) {
+            v8::Local<v8::Value> basic_filter_type = Nan::Get(basic_filter_array, 0).ToLocalChecked();
+            if (!basic_filter_type->IsString()) {
+                return "'basic-filters' must be of the form [string, [filters]]";
+            }
+            Nan::Utf8String basic_filter_type_utf8_value(basic_filter_type);
+            std::int32_t basic_filter_type_str_len = basic_filter_type_utf8_value.length();
+            std::string basic_filter_type_str(*basic_filter_type_utf8_value, static_cast<std::size_t>(basic_filter_type_str_len));
+            if (basic_filter_type_str == "all") {
+                query_data.basic_filter.type = filter_all;
+            } else if (basic_filter_type_str == "any") {
+                query_data.basic_filter.type = filter_any;
+            } else {
+                return "'basic-filters[0] must be 'any' or 'all'";
+            }
+
+            v8::Local<v8::Value> filters_array_val = Nan::Get(basic_filter_array, 1).ToLocalChecked();
+            if (!filters_array_val->IsArray()) {
+                return "'basic-filters' must be of the form [type, [filters]]";
+            }
+
+            v8::Local<v8::Array> filters_array = filters_array_val.As<v8::Array>();
+            unsigned num_filters = filters_array->Length();
+            for (unsigned j = 0; j < num_filters; ++j) {
+                basic_filter_struct filter;
+                v8::Local<v8::Value> filter_val = Nan::Get(filters_array, j).ToLocalChecked();
+                if (!filter_val->IsArray()) {
+                    return "filters must be of the form [parameter, condition, value]";
+                }
+                v8::Local<v8::Array> filter_array = filter_val.As<v8::Array>();
+                unsigned filter_length = filter_array->Length();
+
+                if (filter_length != 3) {
+                    return "filters must be of the form [parameter, condition, value]";
+                }
+
+                v8::Local<v8::Value> filter_parameter_val = Nan::Get(filter_array, 0).ToLocalChecked();
+                if (!filter_parameter_val->IsString()) {
+                    return "parameter filter option must be a string";
+                }
+
+                Nan::Utf8String filter_parameter_utf8_value(filter_parameter_val);
+                std::int32_t filter_parameter_len = filter_parameter_utf8_value.length();
+                if (filter_parameter_len <= 0) {
+                    return "parameter filter value must be a non-empty string";
+                }
+
+                std::string filter_parameter(*filter_parameter_utf8_value, static_cast<std::size_t>(filter_parameter_len));
+                filter.key.assign(filter_parameter);
+
+                v8::Local<v8::Value> filter_condition_val = Nan::Get(filter_array, 1).ToLocalChecked();
+                if (!filter_condition_val->IsString()) {
+                    return "condition filter option must be a string";
+                }
+
+                Nan::Utf8String filter_condition_utf8_value(filter_condition_val);
+                std::int32_t filter_condition_len = filter_condition_utf8_value.length();
+                if (filter_condition_len <= 0) {
+                    return "condition filter value must be a non-empty string";
+                }
+
+                std::string filter_condition(*filter_condition_utf8_value, static_cast<std::size_t>(filter_condition_len));
+
+                if (filter_condition == "=") {
+                    filter.type = eq;
+                } else if (filter_condition == "!=") {
+                    filter.type = ne;
+                } else if (filter_condition == "<") {
+                    filter.type = lt;
+                } else if (filter_condition == "<=") {
+                    filter.type = lte;
+                } else if (filter_condition == ">") {
+                    filter.type = gt;
+                } else if (filter_condition == ">=") {
+                    filter.type = gte;
                 } else {
-                    return utils::CallbackError("'basic-filters[0] must be 'any' or 'all'", callback);
+                    return "condition filter value must be =, !=, <, <=, >, or >=";
                 }
 
-                v8::Local<v8::Value> filters_array_val = Nan::Get(basic_filter_array, 1).ToLocalChecked();
-                if (!filters_array_val->IsArray()) {
-                    return utils::CallbackError("'basic-filters' must be of the form [type, [filters]]", callback);
+                v8::Local<v8::Value> filter_value_val = Nan::Get(filter_array, 2).ToLocalChecked();
+                if (filter_value_val->IsNumber()) {
+                    double filter_value_double = Nan::To<double>(filter_value_val).FromJust();
+                    filter.value = filter_value_double;
+                } else if (filter_value_val->IsBoolean()) {
+                    filter.value = Nan::To<bool>(filter_value_val).FromJust();
+                } else {
+                    return "value filter value must be a number or boolean";
                 }
+                query_data.basic_filter.filters.push_back(filter);
+            }
+        } else {
+            return "'basic-filters' must be of the form [type, [filters]]";
+        }
+    }
+    return nullptr;
+}
 
-                v8::Local<v8::Array> filters_array = filters_array_val.As<v8::Array>();
-                unsigned num_filters = filters_array->Length();
-                for (unsigned j = 0; j < num_filters; ++j) {
-                    basic_filter_struct filter;
-                    v8::Local<v8::Value> filter_val = Nan::Get(filters_array, j).ToLocalChecked();
-                    if (!filter_val->IsArray()) {
-                        return utils::CallbackError("filters must be of the form [parameter, condition, value]", callback);
-                    }
-                    v8::Local<v8::Array> filter_array = filter_val.As<v8::Array>();
-                    unsigned filter_length = filter_array->Length();
+NAN_METHOD(vtquery) {
+    // validate callback function
+    v8::Local<v8::Value> callback_val = info[info.Length() - 1];
+    if (!callback_val->IsFunction()) {
+        Nan::ThrowError("last argument must be a callback function");
+        return;
+    }
+    v8::Local<v8::Function> callback = callback_val.As<v8::Function>();
 
-                    if (filter_length != 3) {
-                        return utils::CallbackError("filters must be of the form [parameter, condition, value]", callback);
-                    }
+    // validate tiles
+    if (!info[0]->IsArray()) {
+        return utils::CallbackError("first arg 'tiles' must be an array of tile objects", callback);
+    }
 
-                    v8::Local<v8::Value> filter_parameter_val = Nan::Get(filter_array, 0).ToLocalChecked();
-                    if (!filter_parameter_val->IsString()) {
-                        return utils::CallbackError("parameter filter option must be a string", callback);
-                    }
+    v8::Local<v8::Array> tiles_arr_val = info[0].As<v8::Array>();
+    unsigned num_tiles = tiles_arr_val->Length();
 
-                    Nan::Utf8String filter_parameter_utf8_value(filter_parameter_val);
-                    std::int32_t filter_parameter_len = filter_parameter_utf8_value.length();
-                    if (filter_parameter_len <= 0) {
-                        return utils::CallbackError("parameter filter value must be a non-empty string", callback);
-                    }
+    if (num_tiles <= 0) {
+        return utils::CallbackError("'tiles' array must be of length greater than 0", callback);
+    }
 
-                    std::string filter_parameter(*filter_parameter_utf8_value, static_cast<std::size_t>(filter_parameter_len));
-                    filter.key.assign(filter_parameter);
+    std::unique_ptr<QueryData> query_data = std::make_unique<QueryData>(num_tiles);
 
-                    v8::Local<v8::Value> filter_condition_val = Nan::Get(filter_array, 1).ToLocalChecked();
-                    if (!filter_condition_val->IsString()) {
-                        return utils::CallbackError("condition filter option must be a string", callback);
-                    }
+    if (auto const* error = parse_tiles(tiles_arr_val, *query_data)) {
+        return utils::CallbackError(error, callback);
+    }
 
-                    Nan::Utf8String filter_condition_utf8_value(filter_condition_val);
-                    std::int32_t filter_condition_len = filter_condition_utf8_value.length();
-                    if (filter_condition_len <= 0) {
-                        return utils::CallbackError("condition filter value must be a non-empty string", callback);
-                    }
+    // validate lng/lat array
+    if (!info[1]->IsArray()) {
+        return utils::CallbackError("second arg 'lnglat' must be an array with [longitude, latitude] values", callback);
+    }
 
-                    std::string filter_condition(*filter_condition_utf8_value, static_cast<std::size_t>(filter_condition_len));
-
-                    if (filter_condition == "=") {
-                        filter.type = eq;
-                    } else if (filter_condition == "!=") {
-                        filter.type = ne;
-                    } else if (filter_condition == "<") {
-                        filter.type = lt;
-                    } else if (filter_condition == "<=") {
-                        filter.type = lte;
-                    } else if (filter_condition == ">") {
-                        filter.type = gt;
-                    } else if (filter_condition == ">=") {
-                        filter.type = gte;
-                    } else {
-                        return utils::CallbackError("condition filter value must be =, !=, <, <=, >, or >=", callback);
-                    }
+    // v8::Local<v8::Array> lnglat_val(info[1]);
+    v8::Local<v8::Array> lnglat_val = info[1].As<v8::Array>();
+    if (lnglat_val->Length() != 2) {
+        return utils::CallbackError("'lnglat' must be an array of [longitude, latitude]", callback);
+    }
 
-                    v8::Local<v8::Value> filter_value_val = Nan::Get(filter_array, 2).ToLocalChecked();
-                    if (filter_value_val->IsNumber()) {
-                        double filter_value_double = Nan::To<double>(filter_value_val).FromJust();
-                        filter.value = filter_value_double;
-                    } else if (filter_value_val->IsBoolean()) {
-                        filter.value = Nan::To<bool>(filter_value_val).FromJust();
-                    } else {
-                        return utils::CallbackError("value filter value must be a number or boolean", callback);
-                    }
-                    query_data->basic_filter.filters.push_back(filter);
-                }
-            } else {
-                return utils::CallbackError("'basic-filters' must be of the form [type, [filters]]", callback);
-            }
+    v8::Local<v8::Value> lng_val = Nan::Get(lnglat_val, 0).ToLocalChecked();
+    v8::Local<v8::Value> lat_val = Nan::Get(lnglat_val, 1).ToLocalChecked();
+    if (!lng_val->IsNumber() || !lat_val->IsNumber()) {
+        return utils::CallbackError("lnglat values must be numbers", callback);
+    }
+    query_data->longitude = Nan::To<double>(lng_val).FromJust();
+    query_data->latitude = Nan::To<double>(lat_val).FromJust();
+
+    // validate options object if it exists
+    // defaults are set in the QueryData struct.
+    if (info.Length() > 3) {
+
+        if (!info[2]->IsObject()) {
+            return utils::CallbackError("'options' arg must be an object", callback);
+        }
+
+        v8::Local<v8::Object> options = info[2]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+        if (auto const* error = parse_options(options, *query_data)) {
+            return utils::CallbackError(error, callback);
         }
     }
 
@@ -921,4 +2800,189 @@ NAN_METHOD(vtquery) {
     Nan::AsyncQueueWorker(worker);
 }
 
+NAN_METHOD(batch) {
+    // validate callback function
+    v8::Local<v8::Value> callback_val = info[info.Length() - 1];
+    if (!callback_val->IsFunction()) {
+        Nan::ThrowError("last argument must be a callback function");
+        return;
+    }
+    v8::Local<v8::Function> callback = callback_val.As<v8::Function>();
+
+    // validate tiles
+    if (!info[0]->IsArray()) {
+        return utils::CallbackError("first arg 'tiles' must be an array of tile objects", callback);
+    }
+
+    v8::Local<v8::Array> tiles_arr_val = info[0].As<v8::Array>();
+    unsigned num_tiles = tiles_arr_val->Length();
+
+    if (num_tiles <= 0) {
+        return utils::CallbackError("'tiles' array must be of length greater than 0", callback);
+    }
+
+    std::unique_ptr<QueryData> query_data = std::make_unique<QueryData>(num_tiles);
+
+    if (auto const* error = parse_tiles(tiles_arr_val, *query_data)) {
+        return utils::CallbackError(error, callback);
+    }
+
+    // validate points array
+    if (!info[1]->IsArray()) {
+        return utils::CallbackError("second arg 'points' must be an array of [longitude, latitude] arrays", callback);
+    }
+
+    v8::Local<v8::Array> points_arr_val = info[1].As<v8::Array>();
+    unsigned num_points = points_arr_val->Length();
+
+    if (num_points <= 0) {
+        return utils::CallbackError("'points' array must be of length greater than 0", callback);
+    }
+
+    std::vector<mapbox::geometry::point<double>> points;
+    points.reserve(num_points);
+    for (unsigned p = 0; p < num_points; ++p) {
+        v8::Local<v8::Value> lnglat_val = Nan::Get(points_arr_val, p).ToLocalChecked();
+        if (!lnglat_val->IsArray() || lnglat_val.As<v8::Array>()->Length() != 2) {
+            return utils::CallbackError("items in 'points' array must be arrays of [longitude, latitude]", callback);
+        }
+        v8::Local<v8::Value> lng_val = Nan::Get(lnglat_val.As<v8::Array>(), 0).ToLocalChecked();
+        v8::Local<v8::Value> lat_val = Nan::Get(lnglat_val.As<v8::Array>(), 1).ToLocalChecked();
+        if (!lng_val->IsNumber() || !lat_val->IsNumber()) {
+            return utils::CallbackError("lnglat values must be numbers", callback);
+        }
+        points.emplace_back(Nan::To<double>(lng_val).FromJust(), Nan::To<double>(lat_val).FromJust());
+    }
+
+    // validate options object if it exists
+    if (info.Length() > 3) {
+
+        if (!info[2]->IsObject()) {
+            return utils::CallbackError("'options' arg must be an object", callback);
+        }
+
+        v8::Local<v8::Object> options = info[2]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+        if (auto const* error = parse_options(options, *query_data)) {
+            return utils::CallbackError(error, callback);
+        }
+    }
+    // the points are spread over the thread pool instead, and the tiles are loaded
+    // before they are queried
+    query_data->parallel = false;
+    query_data->streaming = false;
+
+    auto* worker = new BatchWorker{std::move(query_data), std::move(points), new Nan::Callback{callback}};
+    Nan::AsyncQueueWorker(worker);
+}
+
+NAN_METHOD(join) {
+    // validate callback function
+    v8::Local<v8::Value> callback_val = info[info.Length() - 1];
+    if (!callback_val->IsFunction()) {
+        Nan::ThrowError("last argument must be a callback function");
+        return;
+    }
+    v8::Local<v8::Function> callback = callback_val.As<v8::Function>();
+
+    // validate tile
+    if (!info[0]->IsObject()) {
+        return utils::CallbackError("first arg 'tile' must be a tile object or VectorTileHandle", callback);
+    }
+
+    std::unique_ptr<QueryData> query_data = std::make_unique<QueryData>(1);
+
+    if (auto const* error = parse_tile(info[0], *query_data)) {
+        return utils::CallbackError(error, callback);
+    }
+
+    // validate points
+    if (!info[1]->IsFloat64Array()) {
+        return utils::CallbackError("second arg 'points' must be a Float64Array of longitude and latitude pairs", callback);
+    }
+
+    Nan::TypedArrayContents<double> points_contents(info[1]);
+    if (points_contents.length() % 2 != 0) {
+        return utils::CallbackError("'points' must have an even length", callback);
+    }
+
+    std::vector<double> points(*points_contents, *points_contents + points_contents.length());
+    for (auto const value : points) {
+        if (!std::isfinite(value)) {
+            return utils::CallbackError("'points' values must be finite numbers", callback);
+        }
+    }
+
+    // validate options object if it exists
+    if (info.Length() > 3) {
+
+        if (!info[2]->IsObject()) {
+            return utils::CallbackError("'options' arg must be an object", callback);
+        }
+
+        v8::Local<v8::Object> options = info[2]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+
+        if (Nan::Has(options, Nan::New("layers").ToLocalChecked()).FromMaybe(false)) {
+            if (auto const* error = parse_layers(Nan::Get(options, Nan::New("layers").ToLocalChecked()).ToLocalChecked(), query_data->layers)) {
+                return utils::CallbackError(error, callback);
+            }
+        }
+
+        if (Nan::Has(options, Nan::New("properties").ToLocalChecked()).FromMaybe(false)) {
+            if (auto const* error = parse_properties(Nan::Get(options, Nan::New("properties").ToLocalChecked()).ToLocalChecked(), *query_data)) {
+                return utils::CallbackError(error, callback);
+            }
+        }
+    }
+
+    auto* worker = new JoinWorker{std::move(query_data), std::move(points), new Nan::Callback{callback}};
+    Nan::AsyncQueueWorker(worker);
+}
+
+NAN_METHOD(setCacheSize) {
+    if (info.Length() < 1 || !info[0]->IsNumber()) {
+        return Nan::ThrowTypeError("cache size must be a number of bytes");
+    }
+    double const size = Nan::To<double>(info[0]).FromJust();
+    if (!std::isfinite(size)) {
+        return Nan::ThrowTypeError("cache size must be a finite number of bytes");
+    }
+    if (size < 0.0) {
+        return Nan::ThrowTypeError("cache size must not be negative");
+    }
+    // the largest 64 bit std::size_t rounds up to 2^64 as a double, which does not fit
+    if (size >= 18446744073709551616.0 || size > static_cast<double>(std::numeric_limits<std::size_t>::max())) {
+        return Nan::ThrowTypeError("cache size is too large");
+    }
+    tile_cache::shared().set_capacity(static_cast<std::size_t>(size));
+}
+
+NAN_METHOD(cacheStats) {
+    tile_cache::statistics const stats = tile_cache::shared().stats();
+    v8::Local<v8::Object> stats_obj = Nan::New<v8::Object>();
+    Nan::Set(stats_obj, Nan::New("size").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.capacity)));
+    Nan::Set(stats_obj, Nan::New("bytes").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.bytes)));
+    Nan::Set(stats_obj, Nan::New("entries").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.entries)));
+    Nan::Set(stats_obj, Nan::New("hits").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.hits)));
+    Nan::Set(stats_obj, Nan::New("misses").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.misses)));
+    Nan::Set(stats_obj, Nan::New("evictions").ToLocalChecked(), Nan::New<v8::Number>(static_cast<double>(stats.evictions)));
+    info.GetReturnValue().Set(stats_obj);
+}
+
+NAN_METHOD(addZstdDictionary) {
+    if (info.Length() < 1 || !node::Buffer::HasInstance(info[0])) {
+        return Nan::ThrowTypeError("zstd dictionary must be a buffer");
+    }
+    v8::Local<v8::Object> dictionary = info[0]->ToObject(Nan::GetCurrentContext()).ToLocalChecked();
+    try {
+        add_zstd_dictionary(vtzero::data_view{node::Buffer::Data(dictionary), node::Buffer::Length(dictionary)});
+    } catch (std::exception const& e) {
+        return Nan::ThrowError(e.what());
+    }
+}
+
+NAN_METHOD(instructionSet) {
+    info.GetReturnValue().Set(Nan::New(kernels::instruction_set()).ToLocalChecked());
+}
+
 } // namespace VectorTileQuery
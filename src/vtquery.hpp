@@ -3,4 +3,20 @@
 
 namespace VectorTileQuery {
 NAN_METHOD(vtquery);
+
+// many query points against the same tiles
+NAN_METHOD(batch);
+
+// the polygons of a tile that contain each of many points
+NAN_METHOD(join);
+
+// size (in bytes) and statistics of the process-wide cache of decompressed tiles
+NAN_METHOD(setCacheSize);
+NAN_METHOD(cacheStats);
+
+// dictionaries for zstd compressed tiles
+NAN_METHOD(addZstdDictionary);
+
+// the instruction set of the segment kernels
+NAN_METHOD(instructionSet);
 }
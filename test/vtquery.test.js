@@ -14,6 +14,93 @@ function checkClose(a, b, epsilon) {
   return 1*(a-b) < epsilon;
 }
 
+// minimal vector tile encoder for synthesized fixtures. Layers are {name, extent, features},
+// features are {id, type, geometry, properties} with string properties, and the geometry is
+// a list of points for points (type 1) and a list of lines or rings of points otherwise.
+function varint(out, n) {
+  while (n > 127) {
+    out.push((n % 128) | 128);
+    n = Math.floor(n / 128);
+  }
+  out.push(n);
+}
+
+function field(out, tag, type) {
+  varint(out, tag * 8 + type);
+}
+
+function bytes(out, tag, data) {
+  field(out, tag, 2);
+  varint(out, data.length);
+  for (let i = 0; i < data.length; ++i) out.push(data[i]);
+}
+
+function zigzag(n) {
+  return n < 0 ? -2 * n - 1 : 2 * n;
+}
+
+function encodeGeometry(type, geometry) {
+  const out = [];
+  let x = 0;
+  let y = 0;
+  const parts = type === 1 ? [geometry] : geometry;
+  parts.forEach(part => {
+    const moveTo = type === 1 ? part.length : 1;
+    varint(out, (moveTo << 3) | 1);
+    part.forEach((pt, i) => {
+      if (type !== 1 && i === 1) varint(out, ((part.length - 1) << 3) | 2);
+      varint(out, zigzag(pt[0] - x));
+      varint(out, zigzag(pt[1] - y));
+      x = pt[0];
+      y = pt[1];
+    });
+    if (type === 3) varint(out, (1 << 3) | 7);
+  });
+  return out;
+}
+
+function encodeTile(layers) {
+  const tile = [];
+  layers.forEach(layer => {
+    const out = [];
+    const keys = [];
+    const values = [];
+    field(out, 15, 0);
+    varint(out, 2);
+    bytes(out, 1, Buffer.from(layer.name));
+    layer.features.forEach(feature => {
+      const f = [];
+      if (feature.id !== undefined) {
+        field(f, 1, 0);
+        varint(f, feature.id);
+      }
+      const tags = [];
+      Object.keys(feature.properties || {}).forEach(key => {
+        if (keys.indexOf(key) < 0) keys.push(key);
+        const value = String(feature.properties[key]);
+        if (values.indexOf(value) < 0) values.push(value);
+        varint(tags, keys.indexOf(key));
+        varint(tags, values.indexOf(value));
+      });
+      if (tags.length) bytes(f, 2, tags);
+      field(f, 3, 0);
+      varint(f, feature.type);
+      bytes(f, 4, encodeGeometry(feature.type, feature.geometry));
+      bytes(out, 2, f);
+    });
+    keys.forEach(key => bytes(out, 3, Buffer.from(key)));
+    values.forEach(value => {
+      const v = [];
+      bytes(v, 1, Buffer.from(value));
+      bytes(out, 4, v);
+    });
+    field(out, 5, 0);
+    varint(out, layer.extent || 4096);
+    bytes(tile, 3, out);
+  });
+  return Buffer.from(tile);
+}
+
 test('failure: fails without callback function', assert => {
   try {
     vtquery();
@@ -293,6 +380,72 @@ test('failure: options.dedupe is not a boolean', assert => {
   });
 });
 
+test('failure: options.dedupe_key is not a string', assert => {
+  const opts = {
+    dedupe_key: 1
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'dedupe_key\' option must be a string');
+    assert.end();
+  });
+});
+
+test('failure: options.dedupe_key is not an accepted value', assert => {
+  const opts = {
+    dedupe_key: 'name'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'dedupe_key\' must be \'id\', \'properties\', or \'both\'');
+    assert.end();
+  });
+});
+
+test('failure: options.tile_distance is not a boolean', assert => {
+  const opts = {
+    tile_distance: 'yes'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'tile_distance\' must be a boolean');
+    assert.end();
+  });
+});
+
+test('failure: options.stats is not a boolean', assert => {
+  const opts = {
+    stats: 'yes'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'stats\' must be a boolean');
+    assert.end();
+  });
+});
+
+test('failure: options.parallel is not a boolean', assert => {
+  const opts = {
+    parallel: 'yes'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'parallel\' must be a boolean');
+    assert.end();
+  });
+});
+
+test('failure: options.streaming is not a boolean', assert => {
+  const opts = {
+    streaming: 'yes'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'streaming\' must be a boolean');
+    assert.end();
+  });
+});
+
 test('failure: options.radius is not a number', assert => {
   const opts = {
     radius: '4'
@@ -392,6 +545,28 @@ test('failure: options.layers includes empty strings', assert => {
   });
 });
 
+test('failure: options.properties is not an array or a boolean', assert => {
+  const opts = {
+    properties: 'name'
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'properties\' must be an array of strings or a boolean');
+    assert.end();
+  });
+});
+
+test('failure: options.properties includes non string values', assert => {
+  const opts = {
+    properties: ['name', 4]
+  };
+  vtquery([{buffer: new Buffer('hey'), z: 0, x: 0, y: 0}], [47.6, -122.3], opts, function(err, result) {
+    assert.ok(err);
+    assert.equal(err.message, '\'properties\' values must be strings');
+    assert.end();
+  });
+});
+
 test('failure: options.geometry is not a string', assert => {
   const opts = {
     geometry: 1234
@@ -479,6 +654,27 @@ test('options - radius: all results are in expected order', assert => {
   });
 });
 
+test('options - tile_distance: results match the exact distance path', assert => {
+  const buffer = fs.readFileSync(path.resolve(__dirname+'/../node_modules/@mapbox/mvt-fixtures/real-world/chicago/13-2098-3045.mvt'));
+  const tiles = [{buffer: buffer, z: 13, x: 2098, y: 3045}];
+  const ll = [-87.7987, 41.8451];
+  vtquery(tiles, ll, { radius: 50 }, function(err, exact) {
+    assert.ifError(err);
+    vtquery(tiles, ll, { radius: 50, tile_distance: true }, function(err, result) {
+      assert.ifError(err);
+      assert.equal(result.features.length, exact.features.length, 'expected number of features');
+      result.features.forEach(function(feature, i) {
+        let e = exact.features[i];
+        assert.equal(e.id, feature.id, 'same id');
+        assert.ok(feature.properties.tilequery.distance <= 50, 'less than radius');
+        assert.ok(checkClose(e.properties.tilequery.distance, feature.properties.tilequery.distance, 1e-6), 'distance is converted exactly');
+        assert.deepEqual(e.geometry.coordinates, feature.geometry.coordinates, 'same coordinates');
+      });
+      assert.end();
+    });
+  });
+});
+
 test('options - radius=0: only returns "point in polygon" results (on a building)', assert => {
   const buffer = bufferSF;
   const ll = [-122.4527, 37.7689]; // direct hit on a building
@@ -547,6 +743,40 @@ test('options - layers: successfully returns only requested layers', assert => {
   });
 });
 
+test('options - properties: only returns the selected properties', assert => {
+  const tiles = [{buffer: bufferSF, z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4477, 37.7665];
+  const opts = {radius: 2000, limit: 20, layers: ['poi_label']};
+  vtquery(tiles, ll, opts, function(err, expected) {
+    assert.ifError(err);
+    assert.ok(expected.features.length > 0, 'has results');
+    vtquery(tiles, ll, Object.assign({properties: ['name', 'type', 'missing']}, opts), function(err, result) {
+      assert.ifError(err);
+      assert.equal(result.features.length, expected.features.length, 'same number of results');
+      result.features.forEach(function(feature, i) {
+        const properties = {tilequery: expected.features[i].properties.tilequery};
+        ['name', 'type'].forEach(function(key) {
+          if (key in expected.features[i].properties) properties[key] = expected.features[i].properties[key];
+        });
+        assert.deepEqual(feature.properties, properties, 'selected properties');
+        assert.deepEqual(feature.geometry, expected.features[i].geometry, 'same geometry');
+      });
+      vtquery(tiles, ll, Object.assign({properties: false}, opts), function(err, result) {
+        assert.ifError(err);
+        result.features.forEach(function(feature, i) {
+          assert.deepEqual(feature.properties, {tilequery: expected.features[i].properties.tilequery}, 'only tilequery');
+          assert.equal(feature.id, expected.features[i].id, 'same id');
+        });
+        vtquery(tiles, ll, Object.assign({properties: true}, opts), function(err, result) {
+          assert.ifError(err);
+          assert.deepEqual(result, expected, 'every property');
+          assert.end();
+        });
+      });
+    });
+  });
+});
+
 test('options - layers: returns zero results for a layer that does not exist - does not error', assert => {
   const buffer = bufferSF;
   const ll = [-122.4477, 37.7665]; // direct hit
@@ -672,6 +902,530 @@ test('options - dedupe: returns duplicate results when dedupe is off', assert =>
   });
 });
 
+test('options - dedupe_key: features with the same id are duplicates when deduping by id', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/canada-covered-square.mvt');
+  const tiles = [
+    {buffer: buffer, z: 11, x: 449, y: 693}, // hit tile
+    {buffer: buffer, z: 11, x: 449, y: 694}
+  ];
+  const opts = {
+    radius: 10000, // about the width of a z15 tile
+    dedupe_key: 'id'
+  }
+  vtquery(tiles, [-100.9797421880223, 50.075683473759085], opts, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'only one feature');
+    assert.equal(result.features[0].properties.tilequery.distance, 0, 'expected distance');
+    assert.equal(result.features[0].properties.id, 'CA', 'expected id');
+    assert.end();
+  });
+});
+
+test('options - dedupe_key: features without an id are never duplicates when deduping by id', assert => {
+  const tiles = [
+    {buffer: mvtf.get('002').buffer, z: 15, x: 5238, y: 12666},
+    {buffer: mvtf.get('002').buffer, z: 15, x: 5237, y: 12666}
+  ];
+  const opts = {
+    radius: 10000, // should encompass each point in each tile
+    dedupe_key: 'id'
+  };
+  vtquery(tiles, [-122.453, 37.767], opts, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 2, 'expected number of features');
+    assert.end();
+  });
+});
+
+test('options - dedupe_key: only properties are compared when deduping by properties', assert => {
+  const tiles = [
+    {buffer: mvtf.get('002').buffer, z: 15, x: 5238, y: 12666},
+    {buffer: mvtf.get('002').buffer, z: 15, x: 5237, y: 12666}
+  ];
+  const opts = {
+    radius: 10000, // should encompass each point in each tile
+    dedupe_key: 'properties'
+  };
+  vtquery(tiles, [-122.453, 37.767], opts, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'expected number of features');
+    assert.end();
+  });
+});
+
+test('options - dedupe_key: features with the same properties and different ids', assert => {
+  const buffer = encodeTile([{name: 'points', features: [
+    {id: 1, type: 1, geometry: [[2048, 2048]], properties: {name: 'a'}},
+    {id: 2, type: 1, geometry: [[2050, 2048]], properties: {name: 'a'}}
+  ]}]);
+  const tiles = [{buffer: buffer, z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4481201171875, 37.76637243960178]; // center of the tile
+  vtquery(tiles, ll, { radius: 100, dedupe_key: 'properties' }, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'duplicates by properties');
+    vtquery(tiles, ll, { radius: 100, dedupe_key: 'both' }, function(err, result) {
+      assert.ifError(err);
+      assert.equal(result.features.length, 2, 'not duplicates by both');
+      assert.end();
+    });
+  });
+});
+
+test('options - dedupe_key: features with the same id and different properties', assert => {
+  const buffer = encodeTile([{name: 'points', features: [
+    {id: 1, type: 1, geometry: [[2048, 2048]], properties: {name: 'a'}},
+    {id: 1, type: 1, geometry: [[2050, 2048]], properties: {name: 'b'}}
+  ]}]);
+  const tiles = [{buffer: buffer, z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4481201171875, 37.76637243960178]; // center of the tile
+  vtquery(tiles, ll, { radius: 100, dedupe_key: 'id' }, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'duplicates by id');
+    vtquery(tiles, ll, { radius: 100, dedupe_key: 'both' }, function(err, result) {
+      assert.ifError(err);
+      assert.equal(result.features.length, 2, 'not duplicates by both');
+      assert.end();
+    });
+  });
+});
+
+test('options - stats: tiles out of the radius are skipped', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/canada-covered-square.mvt');
+  const tiles = [
+    {buffer: buffer, z: 11, x: 449, y: 693}, // hit tile
+    {buffer: buffer, z: 11, x: 449, y: 694},
+    {buffer: buffer, z: 11, x: 440, y: 693} // about 100km away
+  ];
+  const opts = {
+    radius: 10000, // about the width of a z15 tile
+    stats: true
+  }
+  vtquery(tiles, [-100.9797421880223, 50.075683473759085], opts, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'only one feature');
+    assert.equal(result.tilequery.tiles, 3, 'expected number of tiles');
+    assert.equal(result.tilequery.tiles_skipped, 1, 'expected number of skipped tiles');
+    assert.end();
+  });
+});
+
+test('options - stats: tiles further than the results are skipped once the limit is reached', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/canada-covered-square.mvt');
+  const tiles = [
+    {buffer: buffer, z: 11, x: 449, y: 694},
+    {buffer: buffer, z: 11, x: 448, y: 694},
+    {buffer: buffer, z: 11, x: 448, y: 693},
+    {buffer: buffer, z: 11, x: 449, y: 693} // hit tile, queried first
+  ];
+  const opts = {
+    radius: 10000, // about the width of a z15 tile
+    limit: 1,
+    dedupe: false,
+    stats: true
+  }
+  vtquery(tiles, [-100.9797421880223, 50.075683473759085], opts, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.features.length, 1, 'only one feature');
+    assert.equal(result.features[0].properties.tilequery.distance, 0, 'expected distance');
+    assert.equal(result.tilequery.tiles, 4, 'expected number of tiles');
+    assert.equal(result.tilequery.tiles_skipped, 3, 'expected number of skipped tiles');
+    assert.end();
+  });
+});
+
+test('options - stats: no stats by default', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/canada-covered-square.mvt');
+  vtquery([{buffer: buffer, z: 11, x: 449, y: 693}], [-100.9797421880223, 50.075683473759085], {}, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.tilequery, undefined, 'no stats');
+    assert.end();
+  });
+});
+
+test('options - parallel: same results and stats as the serial query', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/canada-covered-square.mvt');
+  const tiles = [
+    {buffer: buffer, z: 11, x: 449, y: 694},
+    {buffer: buffer, z: 11, x: 448, y: 694},
+    {buffer: buffer, z: 11, x: 448, y: 693},
+    {buffer: buffer, z: 11, x: 449, y: 693}
+  ];
+  const ll = [-100.9797421880223, 50.075683473759085];
+  vtquery(tiles, ll, { radius: 10000, limit: 3, stats: true }, function(err, serial) {
+    assert.ifError(err);
+    vtquery(tiles, ll, { radius: 10000, limit: 3, stats: true, parallel: true }, function(err, parallel) {
+      assert.ifError(err);
+      assert.deepEqual(parallel, serial, 'same results');
+      assert.end();
+    });
+  });
+});
+
+test('options - parallel: gzipped tiles', assert => {
+  const buffer = zlib.gzipSync(bufferSF);
+  const tiles = [
+    {buffer: buffer, z: 15, x: 5238, y: 12666},
+    {buffer: buffer, z: 15, x: 5238, y: 12667}
+  ];
+  const ll = [-122.4477, 37.7665];
+  vtquery(tiles, ll, { radius: 1000, limit: 20 }, function(err, serial) {
+    assert.ifError(err);
+    vtquery(tiles, ll, { radius: 1000, limit: 20, parallel: true }, function(err, parallel) {
+      assert.ifError(err);
+      assert.ok(serial.features.length > 0, 'has results');
+      assert.deepEqual(parallel, serial, 'same results');
+      assert.end();
+    });
+  });
+});
+
+test('options - parallel: layers split into ranges of features', assert => {
+  // more than 256KB of encoded features in one layer. Every group of lines has the same geometry and
+  // its features are spread over the whole layer, so the ties of a group straddle every range
+  const features = [];
+  for (let i = 0; i < 6000; ++i) {
+    const group = i % 40;
+    const line = [];
+    for (let k = 0; k < 20; ++k) line.push([100 + 5 * k, 2048 + 20 * group + (k % 2)]);
+    features.push({id: i + 1, type: 2, geometry: [line], properties: {group: String(group)}});
+  }
+  const buffer = encodeTile([{name: 'lines', features: features}]);
+  assert.ok(buffer.length > 300 * 1024, 'large layer');
+  const tiles = [{buffer: buffer, z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4481201171875, 37.76637243960178]; // center of the tile
+  const queries = [
+    { radius: 1000, limit: 1000, dedupe: false },
+    { radius: 1000, limit: 50 },
+    { radius: 1000, limit: 10, dedupe_key: 'properties' }
+  ];
+  const checks = queue(1);
+  queries.forEach(function(options) {
+    checks.defer(function(done) {
+      vtquery(tiles, ll, options, function(err, serial) {
+        assert.ifError(err);
+        assert.equal(serial.features.length, options.limit, 'has results');
+        vtquery(tiles, ll, Object.assign({ parallel: true }, options), function(err, parallel) {
+          assert.ifError(err);
+          assert.deepEqual(parallel, serial, 'same results for ' + JSON.stringify(options));
+          done();
+        });
+      });
+    });
+  });
+  checks.awaitAll(function(err) {
+    assert.ifError(err);
+    assert.end();
+  });
+});
+
+test('options - streaming: same results as inflating the whole tile', assert => {
+  const tiles = [
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666},
+    {buffer: zlib.deflateSync(bufferSF), z: 15, x: 5238, y: 12667}
+  ];
+  const ll = [-122.4477, 37.7665];
+  vtquery(tiles, ll, { radius: 1000, limit: 20, stats: true }, function(err, whole) {
+    assert.ifError(err);
+    vtquery(tiles, ll, { radius: 1000, limit: 20, stats: true, streaming: true }, function(err, streamed) {
+      assert.ifError(err);
+      assert.ok(whole.features.length > 0, 'has results');
+      assert.deepEqual(streamed, whole, 'same results');
+      assert.end();
+    });
+  });
+});
+
+test('options - streaming: results from many layers of several tiles', assert => {
+  // the same tile twice, so the candidates of the second one are compared to results that were
+  // found in the layers of the first one, which have been replaced by the stream since
+  const tiles = [
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666},
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666}
+  ];
+  const ll = [-122.4477, 37.7665];
+  const checks = queue(1);
+  [{ radius: 1000, limit: 200 }, { radius: 1000, limit: 200, dedupe: false }, { radius: 0 }].forEach(function(options) {
+    checks.defer(function(done) {
+      vtquery(tiles, ll, options, function(err, whole) {
+        assert.ifError(err);
+        vtquery(tiles, ll, Object.assign({ streaming: true }, options), function(err, streamed) {
+          assert.ifError(err);
+          assert.deepEqual(streamed, whole, 'same results for ' + JSON.stringify(options));
+          done(null, whole);
+        });
+      });
+    });
+  });
+  checks.awaitAll(function(err, results) {
+    assert.ifError(err);
+    const layers = new Set(results[0].features.map(function(feature) {
+      return feature.properties.tilequery.layer;
+    }));
+    assert.ok(layers.size > 1, 'results from several layers');
+    assert.end();
+  });
+});
+
+test('options - streaming: only the requested layers', assert => {
+  const tiles = [{buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4477, 37.7665];
+  vtquery(tiles, ll, { radius: 2000, limit: 10, layers: ['poi_label'], streaming: true }, function(err, result) {
+    assert.ifError(err);
+    assert.ok(result.features.length > 0, 'has results');
+    result.features.forEach(function(feature) {
+      assert.equal(feature.properties.tilequery.layer, 'poi_label', 'expected layer');
+    });
+    assert.end();
+  });
+});
+
+test('options - streaming: invalid gzipped tile', assert => {
+  const buffer = zlib.gzipSync(Buffer.from('not a vector tile, really not a vector tile'));
+  vtquery([{buffer: buffer, z: 15, x: 5238, y: 12666}], [-122.4477, 37.7665], { streaming: true }, function(err, result) {
+    assert.ok(err);
+    assert.end();
+  });
+});
+
+test('VectorTileHandle: same results as tile objects', assert => {
+  const buffer = zlib.gzipSync(bufferSF);
+  const tiles = [
+    {buffer: buffer, z: 15, x: 5238, y: 12666},
+    {buffer: bufferSF, z: 15, x: 5238, y: 12667}
+  ];
+  const ll = [-122.4477, 37.7665];
+  const q = queue();
+  tiles.forEach(function(tile) {
+    q.defer(vtquery.VectorTileHandle.create, tile);
+  });
+  q.awaitAll(function(err, handles) {
+    assert.ifError(err);
+    assert.equal(handles[0].z, 15, 'expected z');
+    assert.equal(handles[0].x, 5238, 'expected x');
+    assert.equal(handles[1].y, 12667, 'expected y');
+    vtquery(tiles, ll, { radius: 1000, limit: 20, stats: true }, function(err, expected) {
+      assert.ifError(err);
+      vtquery(handles, ll, { radius: 1000, limit: 20, stats: true }, function(err, result) {
+        assert.ifError(err);
+        assert.ok(result.features.length > 0, 'has results');
+        assert.deepEqual(result, expected, 'same results');
+        // handles can be queried again, and mixed with tile objects
+        vtquery([handles[0], tiles[1]], ll, { radius: 1000, limit: 20, stats: true }, function(err, mixed) {
+          assert.ifError(err);
+          assert.deepEqual(mixed, expected, 'same results');
+          assert.end();
+        });
+      });
+    });
+  });
+});
+
+test('VectorTileHandle: indexed handles return the same results', assert => {
+  const tiles = [
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666},
+    {buffer: bufferSF, z: 15, x: 5238, y: 12667}
+  ];
+  const ll = [-122.4477, 37.7665];
+  const queries = [
+    { radius: 0 },
+    { radius: 0, limit: 10, layers: ['building', 'landuse'] },
+    { radius: 50, limit: 20, geometry: 'linestring' },
+    { radius: 1000, limit: 20, stats: true }
+  ];
+  const q = queue();
+  tiles.forEach(function(tile) {
+    q.defer(vtquery.VectorTileHandle.create, tile, { index: true });
+  });
+  q.awaitAll(function(err, handles) {
+    assert.ifError(err);
+    const checks = queue(1);
+    queries.forEach(function(options) {
+      checks.defer(function(done) {
+        vtquery(tiles, ll, options, function(err, expected) {
+          assert.ifError(err);
+          vtquery(handles, ll, options, function(err, result) {
+            assert.ifError(err);
+            assert.deepEqual(result, expected, 'same results for ' + JSON.stringify(options));
+            done();
+          });
+        });
+      });
+    });
+    checks.awaitAll(function(err) {
+      assert.ifError(err);
+      assert.end();
+    });
+  });
+});
+
+test('VectorTileHandle: point in polygon tests of large polygons return the same results', assert => {
+  const tile = {buffer: bufferSF, z: 15, x: 5238, y: 12666};
+  const points = [];
+  for (let i = 0; i < 10; ++i) {
+    for (let j = 0; j < 10; ++j) {
+      points.push([-122.4555 + i * 0.001, 37.7605 + j * 0.0009]);
+    }
+  }
+  const queries = [
+    { radius: 0, limit: 20 },
+    { radius: 20, limit: 20, direct_hit_polygon: true, geometry: 'polygon' }
+  ];
+  vtquery.VectorTileHandle.create(tile, function(err, handle) {
+    assert.ifError(err);
+    const checks = queue(1);
+    queries.forEach(function(options) {
+      points.forEach(function(ll) {
+        checks.defer(function(done) {
+          vtquery([tile], ll, options, function(err, expected) {
+            assert.ifError(err);
+            // the first query builds the slabs of the polygons it tests, the second one uses them
+            vtquery([handle], ll, options, function(err, first) {
+              assert.ifError(err);
+              vtquery([handle], ll, options, function(err, second) {
+                assert.ifError(err);
+                assert.deepEqual(first, expected, 'same results for ' + JSON.stringify(options));
+                assert.deepEqual(second, expected, 'same results again for ' + JSON.stringify(options));
+                done();
+              });
+            });
+          });
+        });
+      });
+    });
+    checks.awaitAll(function(err) {
+      assert.ifError(err);
+      assert.end();
+    });
+  });
+});
+
+test('options - geometry=point: same results as scanning every feature', assert => {
+  const tiles = [
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666},
+    {buffer: bufferSF, z: 15, x: 5238, y: 12667}
+  ];
+  const ll = [-122.4477, 37.7665];
+  const queries = [
+    { radius: 300, geometry: 'point', layers: ['poi_label'] },
+    { radius: 300, limit: 50, geometry: 'point', dedupe: false, layers: ['poi_label', 'housenum_label'] },
+    { radius: 1000, limit: 10, geometry: 'point', dedupe_key: 'id', layers: ['poi_label'] },
+    { radius: 500, limit: 20, geometry: 'point', tile_distance: true, layers: ['poi_label'] }
+  ];
+  const checks = queue(1);
+  queries.forEach(function(options) {
+    checks.defer(function(done) {
+      vtquery(tiles, ll, options, function(err, points) {
+        assert.ifError(err);
+        assert.ok(points.features.length > 0, 'has results');
+        // without a geometry filter every feature is scanned on its own, the points are then filtered out of
+        // all the results, the limit is only applied afterwards
+        const scanned = Object.assign({}, options, { limit: 1000 });
+        delete scanned.geometry;
+        vtquery(tiles, ll, scanned, function(err, baseline) {
+          assert.ifError(err);
+          assert.ok(baseline.features.length < 1000, 'every feature in the radius');
+          baseline.features = baseline.features.filter(function(feature) {
+            return feature.properties.tilequery.geometry === 'point';
+          }).slice(0, options.limit || 5);
+          assert.deepEqual(points, baseline, 'same results for ' + JSON.stringify(options));
+          done();
+        });
+      });
+    });
+  });
+  checks.awaitAll(function(err) {
+    assert.ifError(err);
+    assert.end();
+  });
+});
+
+test('failure: VectorTileHandle.create fails with an invalid tile', assert => {
+  // a layer that is longer than the buffer
+  vtquery.VectorTileHandle.create({buffer: Buffer.from([0x1a, 0x10, 0x00]), z: 0, x: 0, y: 0}, function(err, handle) {
+    assert.ok(err);
+    assert.notOk(handle, 'no handle');
+    assert.end();
+  });
+});
+
+test('failure: VectorTileHandle.create validates its arguments', assert => {
+  vtquery.VectorTileHandle.create('tile', function(err) {
+    assert.equal(err.message, 'first arg \'tile\' must be an object with buffer, z, x and y values', 'expected error message');
+    vtquery.VectorTileHandle.create({buffer: 'hi', z: 0, x: 0, y: 0}, function(err) {
+      assert.equal(err.message, '\'buffer\' value of the tile is not a true buffer', 'expected error message');
+      vtquery.VectorTileHandle.create({buffer: bufferSF, z: 15, x: -1, y: 12666}, function(err) {
+        assert.equal(err.message, '\'x\' value of the tile must be an int32 not less than zero', 'expected error message');
+        vtquery.VectorTileHandle.create({buffer: bufferSF, z: 15, x: 5238, y: 12666}, 'index', function(err) {
+          assert.equal(err.message, '\'options\' arg must be an object', 'expected error message');
+          vtquery.VectorTileHandle.create({buffer: bufferSF, z: 15, x: 5238, y: 12666}, { index: 1 }, function(err) {
+            assert.equal(err.message, '\'index\' must be a boolean', 'expected error message');
+            assert.end();
+          });
+        });
+      });
+    });
+  });
+});
+
+test('failure: VectorTileHandle cannot be constructed directly', assert => {
+  assert.throws(function() {
+    new vtquery.VectorTileHandle();
+  }, /VectorTileHandle objects are created with VectorTileHandle.create\(\)/);
+  assert.end();
+});
+
+test('tile cache: gzipped tiles are decompressed once', assert => {
+  const tiles = [{buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666}];
+  const ll = [-122.4477, 37.7665];
+  vtquery(tiles, ll, { radius: 100 }, function(err, uncached) {
+    assert.ifError(err);
+    vtquery.setCacheSize(16 * 1024 * 1024);
+    const before = vtquery.cacheStats();
+    vtquery(tiles, ll, { radius: 100 }, function(err, first) {
+      assert.ifError(err);
+      // a copy of the buffer is found by its bytes
+      vtquery([{buffer: Buffer.from(tiles[0].buffer), z: 15, x: 5238, y: 12666}], ll, { radius: 100 }, function(err, second) {
+        assert.ifError(err);
+        assert.deepEqual(first, uncached, 'same results as without the cache');
+        assert.deepEqual(second, uncached, 'same results from the cached tile');
+        const stats = vtquery.cacheStats();
+        assert.equal(stats.size, 16 * 1024 * 1024, 'expected size');
+        assert.equal(stats.misses - before.misses, 1, 'first query missed');
+        assert.equal(stats.hits - before.hits, 1, 'second query hit');
+        assert.equal(stats.entries, 1, 'one tile cached');
+        assert.ok(stats.bytes > tiles[0].buffer.length, 'compressed and decompressed bytes are counted');
+
+        vtquery.setCacheSize(0);
+        const emptied = vtquery.cacheStats();
+        assert.equal(emptied.entries, 0, 'no tiles cached');
+        assert.equal(emptied.bytes, 0, 'no bytes cached');
+        assert.equal(emptied.evictions - stats.evictions, 1, 'tile evicted');
+        assert.end();
+      });
+    });
+  });
+});
+
+test('failure: setCacheSize validates its argument', assert => {
+  assert.throws(function() {
+    vtquery.setCacheSize('lots');
+  }, /cache size must be a number of bytes/);
+  assert.throws(function() {
+    vtquery.setCacheSize(-1);
+  }, /cache size must not be negative/);
+  assert.throws(function() {
+    vtquery.setCacheSize(NaN);
+  }, /cache size must be a finite number of bytes/);
+  assert.throws(function() {
+    vtquery.setCacheSize(Infinity);
+  }, /cache size must be a finite number of bytes/);
+  assert.throws(function() {
+    vtquery.setCacheSize(Math.pow(2, 64));
+  }, /cache size is too large/);
+  assert.equal(vtquery.cacheStats().size, 0, 'size is unchanged');
+  assert.end();
+});
+
 test('options - dedupe: compare fields for features that have no id (increases coverage)', assert => {
   const tiles = [
     {buffer: mvtf.get('002').buffer, z: 15, x: 5238, y: 12666},
@@ -1067,3 +1821,414 @@ test('success: handles multiple zoom levels (with compressed tiles)', assert =>
     assert.end();
   });
 });
+
+test('success: zlib, gzip and concatenated gzip tiles return the same results', assert => {
+  const ll = [-122.4477, 37.7665];
+  const buffers = [
+    zlib.gzipSync(bufferSF),
+    zlib.deflateSync(bufferSF),
+    // only the first gzip member is read
+    Buffer.concat([zlib.gzipSync(bufferSF), zlib.gzipSync(Buffer.from('not a tile'))])
+  ];
+  vtquery([{buffer: bufferSF, z: 15, x: 5238, y: 12666}], ll, { radius: 100 }, function(err, expected) {
+    assert.ifError(err);
+    const q = queue(1);
+    buffers.forEach(function(buffer) {
+      q.defer(vtquery, [{buffer: buffer, z: 15, x: 5238, y: 12666}], ll, { radius: 100 });
+    });
+    q.awaitAll(function(err, results) {
+      assert.ifError(err);
+      results.forEach(function(result) {
+        assert.deepEqual(result, expected, 'same results as the uncompressed tile');
+      });
+      assert.end();
+    });
+  });
+});
+
+const zstdMissing = 'zstd compressed tiles need vtquery to be built with use_zstd=true';
+
+test('success: zstd compressed tiles return the same results', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/points-properties-16-10498-22872.mvt');
+  const compressed = fs.readFileSync(__dirname + '/fixtures/points-properties-16-10498-22872.mvt.zst');
+  const ll = [-122.3302, 47.6639];
+  vtquery([{buffer: buffer, z: 16, x: 10498, y: 22872}], ll, { radius: 500 }, function(err, expected) {
+    assert.ifError(err);
+    vtquery([{buffer: compressed, z: 16, x: 10498, y: 22872}], ll, { radius: 500 }, function(err, result) {
+      if (err) {
+        assert.equal(err.message, zstdMissing, 'built without zstd');
+        return assert.end();
+      }
+      assert.ok(result.features.length > 0, 'has results');
+      assert.deepEqual(result, expected, 'same results as the uncompressed tile');
+      assert.end();
+    });
+  });
+});
+
+test('success: zstd compressed tiles with a dictionary', assert => {
+  const buffer = fs.readFileSync(__dirname + '/fixtures/points-properties-16-10498-22872.mvt');
+  const compressed = fs.readFileSync(__dirname + '/fixtures/points-properties-16-10498-22872.dict.mvt.zst');
+  const dictionary = fs.readFileSync(__dirname + '/fixtures/points-properties.zstd-dict');
+  const ll = [-122.3302, 47.6639];
+  vtquery([{buffer: compressed, z: 16, x: 10498, y: 22872}], ll, { radius: 500 }, function(err) {
+    assert.ok(err, 'fails without the dictionary');
+    if (err.message === zstdMissing) {
+      assert.throws(function() {
+        vtquery.addZstdDictionary(dictionary);
+      }, /zstd dictionaries need vtquery to be built with use_zstd=true/);
+      return assert.end();
+    }
+    assert.equal(err.message, 'zstd dictionary 905855946 of the tile was not added');
+
+    vtquery.addZstdDictionary(dictionary);
+    // adding it again does nothing
+    vtquery.addZstdDictionary(Buffer.from(dictionary));
+    const changed = Buffer.from(dictionary);
+    changed[changed.length - 1] ^= 0xff;
+    assert.throws(function() {
+      vtquery.addZstdDictionary(changed);
+    }, /a different zstd dictionary with id 905855946 was already added/);
+
+    vtquery([{buffer: buffer, z: 16, x: 10498, y: 22872}], ll, { radius: 500 }, function(err, expected) {
+      assert.ifError(err);
+      vtquery([{buffer: compressed, z: 16, x: 10498, y: 22872}], ll, { radius: 500 }, function(err, result) {
+        assert.ifError(err);
+        assert.deepEqual(result, expected, 'same results as the uncompressed tile');
+        assert.end();
+      });
+    });
+  });
+});
+
+test('failure: addZstdDictionary validates its argument', assert => {
+  assert.throws(function() {
+    vtquery.addZstdDictionary('dictionary');
+  }, /zstd dictionary must be a buffer/);
+  assert.end();
+});
+
+// the kernels are picked when the module is loaded, so every instruction set is queried in its own process
+const kernelScript = `
+const fs = require('fs');
+const vtquery = require(process.argv[1]);
+const input = JSON.parse(process.argv[2]);
+const tiles = input.tiles.map(tile => ({buffer: fs.readFileSync(tile.file), z: tile.z, x: tile.x, y: tile.y}));
+const results = [];
+(function next(i) {
+  if (i === input.queries.length) {
+    return process.stdout.write(JSON.stringify({instructionSet: vtquery.instructionSet(), results: results}));
+  }
+  vtquery(tiles, input.queries[i].ll, input.queries[i].options, function(err, result) {
+    if (err) throw err;
+    results.push(result);
+    next(i + 1);
+  });
+})(0);
+`;
+
+function queryWithInstructionSet(instructionSet, input) {
+  const env = Object.assign({}, process.env);
+  delete env.VTQUERY_INSTRUCTION_SET;
+  if (instructionSet) env.VTQUERY_INSTRUCTION_SET = instructionSet;
+  const output = require('child_process').execFileSync(process.execPath,
+    ['-e', kernelScript, path.resolve(__dirname, '../lib/index.js'), JSON.stringify(input)], {env: env});
+  return JSON.parse(output);
+}
+
+test('instruction sets: every kernel returns the same results', assert => {
+  const input = {
+    tiles: [
+      {file: path.resolve(__dirname + '/../node_modules/@mapbox/mvt-fixtures/real-world/sanfrancisco/15-5238-12666.mvt'), z: 15, x: 5238, y: 12666}
+    ],
+    queries: [
+      {ll: [-122.4477, 37.7665], options: { radius: 1000, limit: 50, geometry: 'linestring' }},
+      {ll: [-122.4477, 37.7665], options: { radius: 1000, limit: 50, geometry: 'polygon' }},
+      {ll: [-122.4527, 37.7689], options: { radius: 0, layers: ['building'] }}, // direct hit on a building
+      {ll: [-122.4527, 37.7689], options: { radius: 0, limit: 50, dedupe: false }},
+      {ll: [-122.4527, 37.7689], options: { radius: 50, limit: 50, direct_hit_polygon: true }}
+    ]
+  };
+  const order = ['avx2', 'sse4.2', 'scalar'];
+  const expected = queryWithInstructionSet(null, input);
+  assert.ok(expected.results.every(result => result.features.length > 0), 'has results');
+  assert.equal(expected.results[2].features[0].properties.tilequery.distance, 0, 'has point in polygon results');
+  order.forEach(function(instructionSet) {
+    const forced = queryWithInstructionSet(instructionSet, input);
+    // a cpu without the forced instruction set uses the best one after it
+    assert.ok(order.indexOf(forced.instructionSet) >= order.indexOf(instructionSet), instructionSet + ' runs as ' + forced.instructionSet);
+    assert.deepEqual(forced.results, expected.results, 'same results with ' + forced.instructionSet);
+  });
+  assert.equal(queryWithInstructionSet('scalar', input).instructionSet, 'scalar', 'scalar can always be forced');
+  assert.equal(queryWithInstructionSet('neon', input).instructionSet, expected.instructionSet, 'unknown instruction sets are ignored');
+  assert.end();
+});
+
+test('batch: same results as a query for every point', assert => {
+  const buffer = zlib.gzipSync(bufferSF);
+  const tiles = [
+    {buffer: buffer, z: 15, x: 5238, y: 12666},
+    {buffer: bufferSF, z: 15, x: 5238, y: 12667}
+  ];
+  const points = [[-122.4477, 37.7665], [-122.4527, 37.7699], [-122.4401, 37.7612], [100, -40]];
+  const opts = { radius: 500, limit: 10, stats: true };
+  vtquery.batch(tiles, points, opts, function(err, results) {
+    assert.ifError(err);
+    assert.equal(results.length, points.length, 'one result per point');
+    const q = queue(1);
+    points.forEach(function(ll) {
+      q.defer(vtquery, tiles, ll, opts);
+    });
+    q.awaitAll(function(err, expected) {
+      assert.ifError(err);
+      assert.ok(expected[0].features.length > 0, 'has results');
+      assert.equal(expected[3].features.length, 0, 'no results far away');
+      assert.deepEqual(results, expected, 'same results');
+      assert.end();
+    });
+  });
+});
+
+test('batch: many points in the same tile', assert => {
+  const tiles = [
+    {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666},
+    {buffer: bufferSF, z: 15, x: 5238, y: 12667}
+  ];
+  const points = [];
+  for (let i = 0; i < 15; ++i) {
+    for (let j = 0; j < 15; ++j) {
+      points.push([-122.4555 + i * 0.0007, 37.7605 + j * 0.0006]);
+    }
+  }
+  const options = [
+    { radius: 50, limit: 5 },
+    { radius: 0 },
+    { radius: 100, limit: 3, geometry: 'point', tile_distance: true },
+    { radius: 30, limit: 10, direct_hit_polygon: true, dedupe_key: 'id' }
+  ];
+  const q = queue(1);
+  options.forEach(function(opts) {
+    q.defer(function(done) {
+      vtquery.batch(tiles, points, opts, function(err, results) {
+        assert.ifError(err);
+        const pq = queue(1);
+        points.forEach(function(ll) {
+          pq.defer(vtquery, tiles, ll, opts);
+        });
+        pq.awaitAll(function(err, expected) {
+          assert.ifError(err);
+          assert.deepEqual(results, expected, 'same results with ' + JSON.stringify(opts));
+          done();
+        });
+      });
+    });
+  });
+  q.awaitAll(function(err) {
+    assert.ifError(err);
+    assert.end();
+  });
+});
+
+test('batch: tile handles', assert => {
+  vtquery.VectorTileHandle.create({buffer: bufferSF, z: 15, x: 5238, y: 12666}, function(err, handle) {
+    assert.ifError(err);
+    const points = [[-122.4477, 37.7665], [-122.4527, 37.7699]];
+    vtquery.batch([handle], points, { radius: 200 }, function(err, results) {
+      assert.ifError(err);
+      vtquery([handle], points[1], { radius: 200 }, function(err, expected) {
+        assert.ifError(err);
+        assert.deepEqual(results[1], expected, 'same results');
+        assert.end();
+      });
+    });
+  });
+});
+
+test('failure: batch with an invalid tile', assert => {
+  vtquery.batch([{buffer: zlib.gzipSync(Buffer.from('hey')), z: 15, x: 5238, y: 12666}], [[-122.4477, 37.7665]], { radius: 10 }, function(err, results) {
+    assert.ok(err);
+    assert.end();
+  });
+});
+
+test('failure: batch validates its arguments', assert => {
+  const tiles = [{buffer: bufferSF, z: 15, x: 5238, y: 12666}];
+  const q = queue(1);
+  q.defer(function(done) {
+    vtquery.batch(tiles, [-122.4477, 37.7665], {}, function(err) {
+      assert.equal(err.message, 'items in \'points\' array must be arrays of [longitude, latitude]');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.batch(tiles, [], {}, function(err) {
+      assert.equal(err.message, '\'points\' array must be of length greater than 0');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.batch(tiles, 'points', {}, function(err) {
+      assert.equal(err.message, 'second arg \'points\' must be an array of [longitude, latitude] arrays');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.batch(tiles, [[-122.4477, '37.7665']], {}, function(err) {
+      assert.equal(err.message, 'lnglat values must be numbers');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.batch(tiles, [[-122.4477, 37.7665]], { radius: '4' }, function(err) {
+      assert.equal(err.message, '\'radius\' must be a number');
+      done();
+    });
+  });
+  q.awaitAll(function() {
+    assert.end();
+  });
+});
+
+test('join: the polygons that contain each point', assert => {
+  const tile = {buffer: zlib.gzipSync(bufferSF), z: 15, x: 5238, y: 12666};
+  const points = new Float64Array([-122.4527, 37.7689, 100, -40]);
+  vtquery.join(tile, points, { layers: ['building'] }, function(err, result) {
+    assert.ifError(err);
+    assert.ok(result.offsets instanceof Uint32Array, 'offsets are a Uint32Array');
+    assert.ok(result.indexes instanceof Uint32Array, 'indexes are a Uint32Array');
+    assert.deepEqual(Array.from(result.offsets), [0, 1, 1], 'one building for the first point, none far away');
+    const feature = result.features[result.indexes[0]];
+    assert.equal(feature.geometry, null, 'no geometry');
+    assert.deepEqual(feature.properties.tilequery, { layer: 'building', geometry: 'polygon' }, 'expected tilequery info');
+    vtquery([tile], [-122.4527, 37.7689], { radius: 0, layers: ['building'] }, function(err, expected) {
+      assert.ifError(err);
+      assert.equal(feature.id, expected.features[0].id, 'same building as a point in polygon query');
+      delete expected.features[0].properties.tilequery.distance;
+      assert.deepEqual(feature.properties, expected.features[0].properties, 'same properties');
+      assert.end();
+    });
+  });
+});
+
+test('join: the same polygons as point in polygon queries', assert => {
+  const tile = {buffer: bufferSF, z: 15, x: 5238, y: 12666};
+  const points = [];
+  for (let i = 0; i < 15; ++i) {
+    for (let j = 0; j < 15; ++j) {
+      points.push(-122.4555 + i * 0.0007, 37.7605 + j * 0.0006);
+    }
+  }
+  // radius 0 queries also hit polygons with an edge within a tile unit of the point, join does not. A point
+  // is away from the edges if the polygons are the same 4 tile units from it in every direction
+  const unit = 360 / (Math.pow(2, 15) * 4096);
+  const offsets = [[0, 0], [4, 0], [-4, 0], [0, 4], [0, -4]];
+  function polygonKeys(collection) {
+    return collection.features.map(function(f) {
+      return JSON.stringify([f.id, f.properties.tilequery.layer]);
+    }).sort();
+  }
+  vtquery.join(tile, new Float64Array(points), {}, function(err, result) {
+    assert.ifError(err);
+    assert.equal(result.offsets.length, points.length / 2 + 1, 'an offset per point');
+    assert.equal(result.indexes.length, result.offsets[points.length / 2], 'an index per match');
+    assert.ok(result.indexes.length > 0, 'has matches');
+    const q = queue(1);
+    for (let i = 0; i < points.length / 2; ++i) {
+      const lat = points[2 * i + 1];
+      offsets.forEach(function(offset) {
+        const ll = [points[2 * i] + offset[0] * unit, lat + offset[1] * unit * Math.cos(lat * Math.PI / 180)];
+        q.defer(vtquery, [tile], ll, { radius: 0, geometry: 'polygon', limit: 1000, dedupe: false });
+      });
+    }
+    q.awaitAll(function(err, collections) {
+      assert.ifError(err);
+      let missing = 0;
+      let different = 0;
+      let away = 0;
+      let awayInPolygons = 0;
+      for (let i = 0; i < points.length / 2; ++i) {
+        const expected = polygonKeys(collections[i * offsets.length]);
+        const joined = [];
+        for (let j = result.offsets[i]; j < result.offsets[i + 1]; ++j) {
+          const f = result.features[result.indexes[j]];
+          joined.push(JSON.stringify([f.id, f.properties.tilequery.layer]));
+        }
+        joined.sort();
+        joined.forEach(function(key) {
+          if (expected.indexOf(key) < 0) ++missing;
+        });
+        const around = collections.slice(i * offsets.length + 1, (i + 1) * offsets.length);
+        if (around.every(function(collection) { return JSON.stringify(polygonKeys(collection)) === JSON.stringify(expected); })) {
+          ++away;
+          if (expected.length > 0) ++awayInPolygons;
+          if (JSON.stringify(joined) !== JSON.stringify(expected)) ++different;
+        }
+      }
+      assert.equal(missing, 0, 'every joined polygon is found by a radius 0 query');
+      assert.ok(away > points.length / 4, 'most points are away from the edges');
+      assert.ok(awayInPolygons > 0, 'some of them are in polygons');
+      assert.equal(different, 0, 'points away from the edges join every polygon a radius 0 query finds');
+      assert.end();
+    });
+  });
+});
+
+test('join: tile handles', assert => {
+  const tile = {buffer: bufferSF, z: 15, x: 5238, y: 12666};
+  const points = new Float64Array([-122.4527, 37.7689, -122.4477, 37.7665]);
+  vtquery.VectorTileHandle.create(tile, function(err, handle) {
+    assert.ifError(err);
+    vtquery.join(handle, points, {}, function(err, result) {
+      assert.ifError(err);
+      vtquery.join(tile, points, {}, function(err, expected) {
+        assert.ifError(err);
+        assert.deepEqual(result, expected, 'same results');
+        assert.end();
+      });
+    });
+  });
+});
+
+test('failure: join validates its arguments', assert => {
+  const tile = {buffer: bufferSF, z: 15, x: 5238, y: 12666};
+  const q = queue(1);
+  q.defer(function(done) {
+    vtquery.join('tile', new Float64Array([-122.4477, 37.7665]), {}, function(err) {
+      assert.equal(err.message, 'first arg \'tile\' must be a tile object or VectorTileHandle');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.join({buffer: bufferSF, z: 15, x: 5238}, new Float64Array([-122.4477, 37.7665]), {}, function(err) {
+      assert.equal(err.message, 'item in \'tiles\' array does not include a \'y\' value');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.join(tile, [[-122.4477, 37.7665]], {}, function(err) {
+      assert.equal(err.message, 'second arg \'points\' must be a Float64Array of longitude and latitude pairs');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.join(tile, new Float64Array([-122.4477, 37.7665, 1]), {}, function(err) {
+      assert.equal(err.message, '\'points\' must have an even length');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.join(tile, new Float64Array([-122.4477, NaN]), {}, function(err) {
+      assert.equal(err.message, '\'points\' values must be finite numbers');
+      done();
+    });
+  });
+  q.defer(function(done) {
+    vtquery.join(tile, new Float64Array([-122.4477, 37.7665]), { layers: 'building' }, function(err) {
+      assert.equal(err.message, '\'layers\' must be an array of strings');
+      done();
+    });
+  });
+  q.awaitAll(function() {
+    assert.end();
+  });
+});